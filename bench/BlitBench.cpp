@@ -0,0 +1,107 @@
+// Compares the per-channel copy loops the packer used to have against the Blit kernels
+// on a 4096x4096 sheet filled with 64x64 sprites
+#include "../src/Blit.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+using namespace QLE::TextureTools;
+using std::cout;
+using std::endl;
+
+namespace {
+    const int SheetSize = 4096;
+    const int SpriteSize = 64;
+    const int Runs = 9;
+
+    // median of a few runs in milliseconds
+    double measure(const std::function<void()>& job) {
+        std::vector<double> times;
+        for (int i = 0; i < Runs; i++) {
+            auto start = std::chrono::steady_clock::now();
+            job();
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        return times[Runs / 2];
+    }
+    void report(const char* name, double baseline, double optimized) {
+        cout << name << ": per-channel " << baseline << " ms, blit " << optimized << " ms, " << baseline / optimized << "x" << endl;
+    }
+}
+
+int main() {
+    std::vector<uint8_t> sheet((size_t)SheetSize * SheetSize * Blit::BytesPerPixel);
+    std::vector<uint8_t> sprite((size_t)SpriteSize * SpriteSize * Blit::BytesPerPixel);
+    for (size_t i = 0; i < sprite.size(); i++) sprite[i] = (uint8_t)(i * 31);
+    const int spritesPerRow = SheetSize / SpriteSize;
+
+    cout << "[Info] Blit kernels built with " << Blit::InstructionSet() << endl;
+
+    // sheet composition
+    double oldCompose = measure([&] {
+        for (int s = 0; s < spritesPerRow * spritesPerRow; s++) {
+            int rectX = (s % spritesPerRow) * SpriteSize, rectY = (s / spritesPerRow) * SpriteSize;
+            for (int y = 0; y < SpriteSize; ++y) {
+                for (int x = 0; x < SpriteSize; ++x) {
+                    int sheet_index = (rectY + y) * SheetSize + (rectX + x);
+                    int img_index = y * SpriteSize + x;
+                    for (int c = 0; c < Blit::BytesPerPixel; ++c)
+                        sheet[sheet_index * Blit::BytesPerPixel + c] = sprite[img_index * Blit::BytesPerPixel + c];
+                }
+            }
+        }
+    });
+    double newCompose = measure([&] {
+        for (int s = 0; s < spritesPerRow * spritesPerRow; s++)
+            Blit::CopyRect(sheet.data(), SheetSize, (s % spritesPerRow) * SpriteSize, (s / spritesPerRow) * SpriteSize,
+                sprite.data(), SpriteSize, 0, 0, SpriteSize, SpriteSize);
+    });
+    report("compose 4096x4096", oldCompose, newCompose);
+
+    // sprite extraction
+    double oldExtract = measure([&] {
+        for (int s = 0; s < spritesPerRow * spritesPerRow; s++) {
+            int rectX = (s % spritesPerRow) * SpriteSize, rectY = (s / spritesPerRow) * SpriteSize;
+            for (int row = 0; row < SpriteSize; ++row) {
+                for (int col = 0; col < SpriteSize; ++col) {
+                    int spriteIndex = (row * SpriteSize + col) * Blit::BytesPerPixel;
+                    int texIndex = ((rectY + row) * SheetSize + (rectX + col)) * Blit::BytesPerPixel;
+                    for (int c = 0; c < Blit::BytesPerPixel; ++c)
+                        sprite[spriteIndex + c] = sheet[texIndex + c];
+                }
+            }
+        }
+    });
+    double newExtract = measure([&] {
+        for (int s = 0; s < spritesPerRow * spritesPerRow; s++)
+            Blit::CopyRect(sprite.data(), SpriteSize, 0, 0, sheet.data(), SheetSize,
+                (s % spritesPerRow) * SpriteSize, (s / spritesPerRow) * SpriteSize, SpriteSize, SpriteSize);
+    });
+    report("extract 4096x4096", oldExtract, newExtract);
+
+    // opaque images get their alpha set to 255
+    const size_t pixels = (size_t)SheetSize * SheetSize;
+    double oldFill = measure([&] {
+        for (size_t i = 0; i < pixels; ++i) sheet[i * Blit::BytesPerPixel + 3] = 255;
+    });
+    double newFill = measure([&] { Blit::FillAlpha(sheet.data(), pixels, 255); });
+    report("alpha fill 4096x4096", oldFill, newFill);
+
+    // trimming a fully transparent sheet has to scan every pixel
+    std::fill(sheet.begin(), sheet.end(), 0);
+    double oldScan = measure([&] {
+        volatile bool found = false;
+        for (size_t i = 0; i < pixels && !found; ++i) found = sheet[i * Blit::BytesPerPixel + 3] != 0;
+    });
+    double newScan = measure([&] {
+        int x, y, w, h;
+        volatile bool found = Blit::FindAlphaBounds(sheet.data(), SheetSize, SheetSize, x, y, w, h);
+        (void)found;
+    });
+    report("alpha bounds 4096x4096", oldScan, newScan);
+    return 0;
+}
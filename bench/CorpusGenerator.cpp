@@ -0,0 +1,127 @@
+#include "CorpusGenerator.h"
+#include <algorithm>
+#include <stdexcept>
+#include "../include/stb_image_write.h"
+
+namespace fs = std::filesystem;
+
+namespace QLE {
+    namespace TextureTools {
+        namespace {
+            // splitmix64, tiny and the same everywhere
+            class Random {
+                uint64_t state;
+            public:
+                explicit Random(uint64_t seed) : state(seed) {}
+                uint64_t Next() {
+                    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+                    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                    return z ^ (z >> 31);
+                }
+                // [0, 1) with 53 bits
+                double Unit() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+                // [low, high]
+                int Range(int low, int high) { return low + (int)(Next() % (uint64_t)(high - low + 1)); }
+            };
+
+            struct Sprite {
+                int width = 0, height = 0;
+                std::vector<uint8_t> pixels;
+            };
+
+            int pickSize(Random& random, const CorpusSettings& settings) {
+                if (settings.distribution == "small") {
+                    // cubing a uniform value leaves most sprites near the minimum
+                    double u = random.Unit();
+                    return settings.minSize + (int)((settings.maxSize - settings.minSize) * u * u * u + 0.5);
+                }
+                return random.Range(settings.minSize, settings.maxSize);
+            }
+            // a gradient with some noise, so the sheets don't compress to nothing
+            Sprite drawSprite(Random& random, const CorpusSettings& settings, bool transparent) {
+                Sprite sprite;
+                sprite.width = pickSize(random, settings);
+                sprite.height = pickSize(random, settings);
+                sprite.pixels.resize((size_t)sprite.width * sprite.height * 4);
+                uint8_t from[3], to[3];
+                for (int c = 0; c < 3; c++) {
+                    from[c] = (uint8_t)random.Range(0, 255);
+                    to[c] = (uint8_t)random.Range(0, 255);
+                }
+                const int noise = random.Range(0, 24);
+                // transparent sprites are an ellipse with empty borders for trimming to remove
+                const int margin = transparent ? random.Range(0, std::min(sprite.width, sprite.height) / 4) : 0;
+                const double centerX = sprite.width / 2.0, centerY = sprite.height / 2.0;
+                const double radiusX = std::max(1.0, centerX - margin), radiusY = std::max(1.0, centerY - margin);
+                for (int y = 0; y < sprite.height; y++) {
+                    for (int x = 0; x < sprite.width; x++) {
+                        uint8_t* pixel = &sprite.pixels[((size_t)y * sprite.width + x) * 4];
+                        const int t = sprite.width + sprite.height > 2 ? (x + y) * 255 / (sprite.width + sprite.height - 2) : 0;
+                        for (int c = 0; c < 3; c++) {
+                            int value = from[c] + (to[c] - from[c]) * t / 255;
+                            if (noise > 0) value += (int)(random.Next() % (uint64_t)(2 * noise + 1)) - noise;
+                            pixel[c] = (uint8_t)std::clamp(value, 0, 255);
+                        }
+                        pixel[3] = 255;
+                        if (!transparent) continue;
+                        const double dx = (x + 0.5 - centerX) / radiusX, dy = (y + 0.5 - centerY) / radiusY;
+                        const double distance = dx * dx + dy * dy;
+                        // a soft edge leaves some translucent pixels as well
+                        if (distance >= 1.0) pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+                        else if (distance > 0.8) pixel[3] = (uint8_t)((1.0 - distance) / 0.2 * 255);
+                    }
+                }
+                return sprite;
+            }
+            void saveSprite(const Sprite& sprite, const std::string& format, const fs::path& path) {
+                const std::string file = path.string();
+                int written = 0;
+                if (format == "png") written = stbi_write_png(file.c_str(), sprite.width, sprite.height, 4, sprite.pixels.data(), sprite.width * 4);
+                else if (format == "tga") written = stbi_write_tga(file.c_str(), sprite.width, sprite.height, 4, sprite.pixels.data());
+                else if (format == "bmp") written = stbi_write_bmp(file.c_str(), sprite.width, sprite.height, 4, sprite.pixels.data());
+                else if (format == "jpg") {
+                    // jpg has no alpha
+                    std::vector<uint8_t> rgb((size_t)sprite.width * sprite.height * 3);
+                    for (size_t i = 0, pixels = (size_t)sprite.width * sprite.height; i < pixels; i++)
+                        for (int c = 0; c < 3; c++) rgb[i * 3 + c] = sprite.pixels[i * 4 + c];
+                    written = stbi_write_jpg(file.c_str(), sprite.width, sprite.height, 3, rgb.data(), 90);
+                }
+                else throw std::runtime_error("Unknown corpus format: " + format);
+                if (!written) throw std::runtime_error("Failed to write " + file);
+            }
+        }
+
+        CorpusInfo GenerateCorpus(const CorpusSettings& settings, const fs::path& folder) {
+            if (settings.minSize < 1 || settings.maxSize < settings.minSize) throw std::runtime_error("Invalid corpus sprite sizes");
+            if (settings.formats.empty()) throw std::runtime_error("The corpus needs at least one format");
+            fs::remove_all(folder);
+
+            Random random(settings.seed);
+            CorpusInfo info;
+            std::vector<Sprite> sprites;
+            for (int i = 0; i < settings.count; i++) {
+                const std::string& format = settings.formats[random.Next() % settings.formats.size()];
+                Sprite sprite;
+                if (!sprites.empty() && random.Unit() < settings.duplicateRatio) sprite = sprites[random.Next() % sprites.size()];
+                else {
+                    sprite = drawSprite(random, settings, random.Unit() < settings.transparentRatio);
+                    // only a few sprites are kept around to copy from, a big corpus would hold all of them otherwise
+                    if (sprites.size() < 256) sprites.push_back(sprite);
+                    else sprites[random.Next() % sprites.size()] = sprite;
+                }
+
+                // a few folders deep, like an art folder
+                fs::path subfolder = folder / ("set" + std::to_string(i % 8)) / ("part" + std::to_string(i % 3));
+                fs::create_directories(subfolder);
+                char name[32];
+                std::snprintf(name, sizeof(name), "sprite%06d.%s", i, format.c_str());
+                saveSprite(sprite, format, subfolder / name);
+                info.files++;
+                info.bytes += fs::file_size(subfolder / name);
+                info.pixels += (uint64_t)sprite.width * sprite.height;
+            }
+            return info;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        // How the sprites of a generated corpus look
+        struct CorpusSettings {
+            int count = 2000;
+            // side lengths in pixels, both inclusive
+            int minSize = 8, maxSize = 128;
+            // uniform, or small: mostly small sprites with a few big ones like most games have
+            std::string distribution = "uniform";
+            // share of the sprites with transparent borders and a round shape
+            double transparentRatio = 0.3;
+            // share of the sprites that are a copy of an earlier one under another name
+            double duplicateRatio = 0.05;
+            // file types picked in turn with the same odds: png, tga, bmp, jpg
+            std::vector<std::string> formats = { "png" };
+            // same seed, same files on every platform
+            uint64_t seed = 1;
+        };
+        struct CorpusInfo {
+            int files = 0;
+            uintmax_t bytes = 0;
+            // sum of the sprite areas
+            uint64_t pixels = 0;
+        };
+        /*
+        * Writes a synthetic sprite corpus into folder, spread over a few subfolders
+        * uses its own random numbers so the files don't depend on the standard library
+        */
+        CorpusInfo GenerateCorpus(const CorpusSettings& settings, const std::filesystem::path& folder);
+    }
+}
@@ -0,0 +1,175 @@
+// Compares reading a sheet .json into a DOM and copying it out, like the readers used to,
+// against the SAX readers that fill the sprites while parsing. the DOM is timed both from the
+// file stream, as the readers did, and from the file in memory, which is what the SAX readers parse
+// the sheet is generated in the format the packer writes with -trim
+//
+// usage: TexturePackerJsonBench [-count=50000] [-runs=9] [-dir=<work_directory>]
+#include "../src/SheetJson.h"
+#include "../samples/SpritesheetReader.h"
+#include "../include/json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+using namespace QLE::TextureTools;
+using std::cout;
+using std::cerr;
+using std::endl;
+namespace fs = std::filesystem;
+
+namespace {
+    // median of a few runs in milliseconds
+    double measure(int runs, const std::function<void()>& job) {
+        std::vector<double> times;
+        for (int i = 0; i < runs; i++) {
+            auto start = std::chrono::steady_clock::now();
+            job();
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        return times[runs / 2];
+    }
+
+    // same fields and layout as exportSpriteInfoToJson
+    void writeSheet(const fs::path& jsonPath, int count) {
+        nlohmann::json json;
+        json["texture"] = "bench_0.png";
+        json["group"] = "bench";
+        json["png"] = { {"encoder", "texturepacker"}, {"level", 6}, {"filter", "adaptive"} };
+        json["sprites"] = nlohmann::json::array();
+        for (int i = 0; i < count; i++) {
+            nlohmann::json sprite;
+            sprite["name"] = "sprite_" + std::to_string(i);
+            sprite["extension"] = i % 3 ? ".png" : ".tga";
+            sprite["position"] = { {"x", (i * 37) % 4096}, {"y", (i / 64) * 16 % 4096} };
+            sprite["pivot"] = { {"x", .5f}, {"y", i % 5 ? .5f : .25f} };
+            sprite["size"] = { {"width", 8 + i % 57}, {"height", 8 + i % 31} };
+            sprite["sourceSize"] = { {"width", 16 + i % 57}, {"height", 16 + i % 31} };
+            sprite["spriteSourceOffset"] = { {"x", i % 8}, {"y", i % 7} };
+            json["sprites"].push_back(sprite);
+        }
+        std::ofstream(jsonPath) << json.dump(4);
+    }
+
+    // copies a parsed sheet out like SpritesheetReader::ReadFile did before it parsed with SAX
+    Spritesheet fromDom(nlohmann::json& jsonInput) {
+        Spritesheet sheet;
+        sheet.group = jsonInput["group"];
+        sheet.texture = jsonInput["texture"];
+        for (const auto& sprite : jsonInput["sprites"]) {
+            SpriteInfo spriteInfo;
+            spriteInfo.name = sprite["name"];
+            spriteInfo.extension = sprite["extension"];
+            spriteInfo.position.x = sprite["position"]["x"];
+            spriteInfo.position.y = sprite["position"]["y"];
+            spriteInfo.size.width = sprite["size"]["width"];
+            spriteInfo.size.height = sprite["size"]["height"];
+            spriteInfo.pivot.x = sprite["pivot"]["x"];
+            spriteInfo.pivot.y = sprite["pivot"]["y"];
+            spriteInfo.sourceSize = spriteInfo.size;
+            if (sprite.contains("sourceSize")) {
+                spriteInfo.sourceSize.width = sprite["sourceSize"]["width"];
+                spriteInfo.sourceSize.height = sprite["sourceSize"]["height"];
+                spriteInfo.sourceOffset.x = sprite["spriteSourceOffset"]["x"];
+                spriteInfo.sourceOffset.y = sprite["spriteSourceOffset"]["y"];
+            }
+            sheet.spriteInfos.push_back(spriteInfo);
+        }
+        return sheet;
+    }
+    // the old reader, parsing from the file stream
+    Spritesheet readWithDomStream(const std::string& jsonPath) {
+        std::ifstream inputFile(jsonPath);
+        nlohmann::json jsonInput;
+        inputFile >> jsonInput;
+        return fromDom(jsonInput);
+    }
+    // the same DOM parsed from the file in memory, like the SAX readers do
+    Spritesheet readWithDomBuffer(const fs::path& jsonPath) {
+        const std::string text = SheetJson::ReadText(jsonPath);
+        nlohmann::json jsonInput = nlohmann::json::parse(text);
+        return fromDom(jsonInput);
+    }
+    bool sameSprites(const Spritesheet& a, const Spritesheet& b) {
+        if (a.group != b.group || a.texture != b.texture || a.spriteInfos.size() != b.spriteInfos.size()) return false;
+        for (size_t i = 0; i < a.spriteInfos.size(); i++) {
+            const SpriteInfo& x = a.spriteInfos[i];
+            const SpriteInfo& y = b.spriteInfos[i];
+            if (x.name != y.name || x.extension != y.extension || x.position.x != y.position.x || x.position.y != y.position.y ||
+                x.size.width != y.size.width || x.size.height != y.size.height || x.pivot.x != y.pivot.x || x.pivot.y != y.pivot.y ||
+                x.sourceSize.width != y.sourceSize.width || x.sourceSize.height != y.sourceSize.height ||
+                x.sourceOffset.x != y.sourceOffset.x || x.sourceOffset.y != y.sourceOffset.y)
+                return false;
+        }
+        return true;
+    }
+    bool sameSprites(const Spritesheet& a, const SheetJson& c) {
+        if (a.group != c.group || a.texture != c.texture || a.spriteInfos.size() != c.sprites.size()) return false;
+        for (size_t i = 0; i < a.spriteInfos.size(); i++) {
+            const SpriteInfo& x = a.spriteInfos[i];
+            const SheetJsonSprite& z = c.sprites[i];
+            if (x.name != z.name || x.extension != z.extension || x.position.x != z.x || x.position.y != z.y || x.size.width != z.width ||
+                x.size.height != z.height || x.pivot.x != z.pivotX || x.pivot.y != z.pivotY || !z.trimmed ||
+                x.sourceSize.width != z.sourceWidth || x.sourceSize.height != z.sourceHeight || x.sourceOffset.x != z.offsetX || x.sourceOffset.y != z.offsetY)
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    int count = 50000, runs = 9;
+    fs::path workDir = fs::temp_directory_path() / "TexturePackerJsonBench";
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.starts_with("-count=")) count = std::max(1, std::stoi(arg.substr(7)));
+            else if (arg.starts_with("-runs=")) runs = std::max(1, std::stoi(arg.substr(6)));
+            else if (arg.starts_with("-dir=")) workDir = arg.substr(5);
+            else {
+                cerr << "[Error] Unknown option " << arg << endl;
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception&) {
+        cerr << "[Error] Invalid number in the options" << endl;
+        return 1;
+    }
+
+    fs::create_directories(workDir);
+    const fs::path jsonPath = workDir / "bench_0.json";
+    const fs::path pngPath = workDir / "bench_0.png";
+    writeSheet(jsonPath, count);
+    // ReadFile only checks that the texture is there
+    std::ofstream(pngPath).put('\0');
+    const double megabytes = fs::file_size(jsonPath) / (1024.0 * 1024.0);
+
+    Spritesheet domStream, dom, sax;
+    SheetJson packer;
+    const double streamTime = measure(runs, [&] { domStream = readWithDomStream(jsonPath.string()); });
+    const double domTime = measure(runs, [&] { dom = readWithDomBuffer(jsonPath); });
+    const double saxTime = measure(runs, [&] { sax = SpritesheetReader::ReadFile(pngPath.string(), jsonPath.string()); });
+    const double packerTime = measure(runs, [&] { packer = SheetJson::Read(jsonPath); });
+    if (!sameSprites(dom, domStream) || !sameSprites(dom, sax) || !sameSprites(dom, packer)) {
+        cerr << "[Error] The readers don't read the same sprites" << endl;
+        return 1;
+    }
+
+    // every row but the stream one reads the file into memory first, so the speedup is against the DOM parsed from the same buffer
+    cout << std::fixed << std::setprecision(2);
+    cout << "[Info] " << count << " sprites, " << megabytes << " MB, median of " << runs << " runs" << endl;
+    auto report = [&](const char* name, double ms) {
+        cout << "  " << std::left << std::setw(28) << name << std::right << std::setw(10) << ms << " ms" << std::setw(10) << megabytes / (ms / 1000.0)
+            << " MB/s" << std::setw(8) << domTime / ms << "x" << endl;
+    };
+    report("dom (stream)", streamTime);
+    report("dom (buffer)", domTime);
+    report("sax SpritesheetReader", saxTime);
+    report("sax SheetJson (unpack)", packerTime);
+    fs::remove_all(workDir);
+    return 0;
+}
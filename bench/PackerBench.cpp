@@ -0,0 +1,189 @@
+// Packs and unpacks a generated sprite corpus a few times and reports the median and p95
+// of every build stage, the whole build and the unpacking, plus how full the sheets are
+// the stage times come from -stats, so they add up the time of every thread working on them
+//
+// usage: TexturePackerBench [-count=2000] [-min=8] [-max=128] [-distribution=uniform|small]
+//        [-transparent=0.3] [-duplicates=0.05] [-formats=png,tga,bmp,jpg] [-seed=1] [-runs=9]
+//        [-dir=<work_directory>] [packer options like -trim -dedup -multibin -threads=4]
+#include "CorpusGenerator.h"
+#include "../src/TexturePacker.h"
+#include "../include/json.hpp"
+#include "../include/stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace QLE::TextureTools;
+using std::cout;
+using std::cerr;
+using std::endl;
+namespace fs = std::filesystem;
+
+namespace {
+    struct Samples {
+        std::vector<double> times;
+        void Add(double ms) { times.push_back(ms); }
+        // nearest rank, so a handful of runs still gives a real measurement
+        double Percentile(double p) const {
+            if (times.empty()) return 0;
+            std::vector<double> sorted = times;
+            std::sort(sorted.begin(), sorted.end());
+            size_t rank = (size_t)std::max(1.0, std::ceil(p / 100.0 * sorted.size()));
+            return sorted[std::min(rank, sorted.size()) - 1];
+        }
+    };
+
+    // the packer prints a lot, which would be measured as well
+    class Silence {
+        std::ostringstream sink;
+        std::streambuf* previous;
+    public:
+        Silence() : previous(cout.rdbuf(sink.rdbuf())) {}
+        ~Silence() { cout.rdbuf(previous); }
+    };
+
+    double elapsed(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::vector<std::string> split(const std::string& list) {
+        std::vector<std::string> parts;
+        std::stringstream stream(list);
+        for (std::string part; std::getline(stream, part, ',');)
+            if (!part.empty()) parts.push_back(part);
+        return parts;
+    }
+    /*
+    * used area of the sheets over their total area
+    * copies packed once by -dedup share a position and are counted once
+    */
+    double fillRatio(const fs::path& outputDir) {
+        uint64_t used = 0, total = 0;
+        for (const auto& entry : fs::directory_iterator(outputDir)) {
+            if (entry.path().extension() != ".json") continue;
+            fs::path sheet = entry.path();
+            sheet.replace_extension(".png");
+            int width = 0, height = 0, channels = 0;
+            if (!stbi_info(sheet.string().c_str(), &width, &height, &channels)) continue;
+            total += (uint64_t)width * height;
+
+            std::ifstream file(entry.path());
+            nlohmann::json json = nlohmann::json::parse(file);
+            std::set<std::pair<int, int>> positions;
+            for (const auto& sprite : json["sprites"]) {
+                if (!positions.emplace(sprite["position"]["x"].get<int>(), sprite["position"]["y"].get<int>()).second) continue;
+                used += (uint64_t)sprite["size"]["width"].get<int>() * sprite["size"]["height"].get<int>();
+            }
+        }
+        return total > 0 ? (double)used / total : 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    CorpusSettings corpus;
+    int runs = 9;
+    fs::path workDir = fs::temp_directory_path() / "TexturePackerBench";
+    std::vector<std::string> packerOptions;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.starts_with("-count=")) corpus.count = std::stoi(arg.substr(7));
+            else if (arg.starts_with("-min=")) corpus.minSize = std::stoi(arg.substr(5));
+            else if (arg.starts_with("-max=")) corpus.maxSize = std::stoi(arg.substr(5));
+            else if (arg.starts_with("-distribution=")) corpus.distribution = arg.substr(14);
+            else if (arg.starts_with("-transparent=")) corpus.transparentRatio = std::stod(arg.substr(13));
+            else if (arg.starts_with("-duplicates=")) corpus.duplicateRatio = std::stod(arg.substr(12));
+            else if (arg.starts_with("-formats=")) corpus.formats = split(arg.substr(9));
+            else if (arg.starts_with("-seed=")) corpus.seed = std::stoull(arg.substr(6));
+            else if (arg.starts_with("-runs=")) runs = std::max(1, std::stoi(arg.substr(6)));
+            else if (arg.starts_with("-dir=")) workDir = arg.substr(5);
+            else packerOptions.push_back(arg);
+        }
+    }
+    catch (std::exception& e) {
+        cerr << "[Error] Invalid benchmark option: " << e.what() << endl;
+        return 1;
+    }
+    if (corpus.distribution != "uniform" && corpus.distribution != "small") {
+        cerr << "[Error] Unknown size distribution " << corpus.distribution << ". Use uniform or small" << endl;
+        return 1;
+    }
+
+    const fs::path inputDir = workDir / "corpus", outputDir = workDir / "sheets", unpackDir = workDir / "unpacked";
+    const fs::path statsFile = workDir / "stats.json";
+    CorpusInfo info;
+    try {
+        auto start = std::chrono::steady_clock::now();
+        info = GenerateCorpus(corpus, inputDir);
+        cout << "[Info] Generated " << info.files << " sprites (" << info.bytes / 1024 << " KB, " << info.pixels / 1000000.0
+            << " Mpixels) in " << elapsed(start) << " ms, seed " << corpus.seed << endl;
+    }
+    catch (std::exception& e) {
+        cerr << "[Error] " << e.what() << endl;
+        return 1;
+    }
+
+    std::vector<std::string> packArgs = { "-p", "-i=" + inputDir.string(), "-o=" + outputDir.string(), "-group=bench", "-stats=" + statsFile.string() };
+    packArgs.insert(packArgs.end(), packerOptions.begin(), packerOptions.end());
+    const std::vector<std::string> unpackArgs = { "-u", "-i=" + outputDir.string(), "-o=" + unpackDir.string() };
+
+    std::map<std::string, Samples> stages;
+    std::vector<std::string> stageOrder;
+    Samples build, unpack;
+    int sheets = 0;
+    for (int run = 0; run < runs; run++) {
+        fs::remove_all(outputDir);
+        fs::remove_all(unpackDir);
+        fs::create_directories(outputDir);
+        fs::create_directories(unpackDir);
+        bool packed, unpacked;
+        double buildMs, unpackMs;
+        {
+            Silence silence;
+            TexturePacker packer;
+            auto start = std::chrono::steady_clock::now();
+            packed = packer.Run(packArgs);
+            buildMs = elapsed(start);
+
+            start = std::chrono::steady_clock::now();
+            unpacked = packer.Run(unpackArgs);
+            unpackMs = elapsed(start);
+        }
+        if (!packed || !unpacked) {
+            cerr << "[Error] Run " << run + 1 << " failed to " << (packed ? "unpack" : "pack") << endl;
+            return 1;
+        }
+        build.Add(buildMs);
+        unpack.Add(unpackMs);
+
+        std::ifstream file(statsFile);
+        nlohmann::json stats = nlohmann::json::parse(file);
+        // the json keeps its keys sorted, this is the order of the build
+        for (const char* name : { "scan", "decode", "plan", "compose", "quantize", "encode", "write", "pngquant", "json", "bin", "pivot" }) {
+            if (!stats["stages"].contains(name)) continue;
+            if (!stages.count(name)) stageOrder.push_back(name);
+            stages[name].Add(stats["stages"][name]["timeMs"].get<double>());
+        }
+        sheets = (int)stats["sheets"].size();
+    }
+
+    cout << std::fixed << std::setprecision(2);
+    cout << "[Info] " << runs << " runs, " << sheets << " sheets, options:";
+    for (const auto& option : packerOptions) cout << " " << option;
+    cout << endl;
+    cout << "  " << std::left << std::setw(12) << "stage" << std::right << std::setw(12) << "median ms" << std::setw(12) << "p95 ms" << endl;
+    for (const auto& name : stageOrder) {
+        // plan is where the rectangles get packed
+        std::string label = name == "plan" ? "pack" : name;
+        cout << "  " << std::left << std::setw(12) << label << std::right << std::setw(12) << stages[name].Percentile(50) << std::setw(12) << stages[name].Percentile(95) << endl;
+    }
+    cout << "  " << std::left << std::setw(12) << "end-to-end" << std::right << std::setw(12) << build.Percentile(50) << std::setw(12) << build.Percentile(95) << endl;
+    cout << "  " << std::left << std::setw(12) << "unpack" << std::right << std::setw(12) << unpack.Percentile(50) << std::setw(12) << unpack.Percentile(95) << endl;
+    cout << "[Info] " << info.files / (build.Percentile(50) / 1000.0) << " sprites/s, atlas fill ratio " << fillRatio(outputDir) * 100 << "%" << endl;
+    return 0;
+}
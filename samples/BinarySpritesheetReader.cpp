@@ -0,0 +1,149 @@
+#include "BinarySpritesheetReader.h"
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace QLE {
+    namespace TextureTools {
+        // the records are used as they are stored, which only works where they're stored the same way
+        static_assert(std::endian::native == std::endian::little, "the .bin is little endian and read in place");
+
+        BinarySpritesheetReader::BinarySpritesheetReader(const std::string& filePathBin)
+        {
+#if defined(_WIN32) || defined(_WIN64)
+            file = CreateFileA(filePathBin.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                file = nullptr;
+                throw std::runtime_error("Failed to open spritesheet metadata: " + filePathBin);
+            }
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize)) {
+                close();
+                throw std::runtime_error("Failed to read spritesheet metadata: " + filePathBin);
+            }
+            size = (size_t)fileSize.QuadPart;
+            mapping = size > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+            data = mapping ? (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+            int descriptor = open(filePathBin.c_str(), O_RDONLY);
+            if (descriptor < 0) throw std::runtime_error("Failed to open spritesheet metadata: " + filePathBin);
+            struct stat status;
+            if (fstat(descriptor, &status) == 0) size = (size_t)status.st_size;
+            if (size > 0) {
+                void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (mapped != MAP_FAILED) data = (const uint8_t*)mapped;
+            }
+            // the mapping stays valid without the descriptor
+            ::close(descriptor);
+#endif
+            if (!data) {
+                close();
+                throw std::runtime_error("Failed to map spritesheet metadata: " + filePathBin);
+            }
+            try { validate(); }
+            catch (const std::runtime_error& e) {
+                close();
+                throw std::runtime_error(std::string(e.what()) + ": " + filePathBin);
+            }
+        }
+        BinarySpritesheetReader::~BinarySpritesheetReader()
+        {
+            close();
+        }
+        void BinarySpritesheetReader::close()
+        {
+#if defined(_WIN32) || defined(_WIN64)
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (file) CloseHandle(file);
+            mapping = file = nullptr;
+#else
+            if (data) munmap((void*)data, size);
+#endif
+            data = nullptr;
+        }
+        void BinarySpritesheetReader::validate()
+        {
+            using namespace BinaryMetadata;
+            if (size < sizeof(Header) || std::memcmp(data, Magic, sizeof(Magic)) != 0) throw std::runtime_error("Not a TexturePacker .bin file");
+            header = (const Header*)data;
+            if (header->version != Version) throw std::runtime_error("Unsupported .bin version " + std::to_string(header->version));
+            if (header->fileSize != size) throw std::runtime_error("Truncated .bin file");
+
+            // every section has to be inside the file and aligned for its records
+            auto section = [&](uint64_t offset, uint64_t bytes, uint64_t alignment = Alignment) {
+                return offset % alignment == 0 && offset + bytes <= size;
+            };
+            if (!section(header->sheetsOffset, (uint64_t)header->sheetCount * sizeof(SheetRecord)) ||
+                !section(header->sheetSpritesOffset, (uint64_t)header->spriteCount * sizeof(uint32_t)) ||
+                !section(header->pilotsOffset, (uint64_t)header->bucketCount * sizeof(uint32_t)) ||
+                !section(header->spritesOffset, (uint64_t)header->spriteCount * sizeof(SpriteRecord), SpriteAlignment) ||
+                !section(header->stringsOffset, header->stringsSize) || header->stringsSize == 0 ||
+                header->indexedCount > header->spriteCount || (header->indexedCount > 0 && header->bucketCount == 0))
+                throw std::runtime_error("Broken .bin file");
+            sheets = (const SheetRecord*)(data + header->sheetsOffset);
+            sheetSprites = (const uint32_t*)(data + header->sheetSpritesOffset);
+            pilots = (const uint32_t*)(data + header->pilotsOffset);
+            sprites = (const SpriteRecord*)(data + header->spritesOffset);
+            strings = (const char*)(data + header->stringsOffset);
+
+            // the table ends with a zero, so a string starting inside it always ends inside it
+            if (strings[header->stringsSize - 1] != '\0' || header->group >= header->stringsSize) throw std::runtime_error("Broken .bin string table");
+            for (uint32_t s = 0; s < header->sheetCount; s++) {
+                const SheetRecord& sheet = sheets[s];
+                if (sheet.texture >= header->stringsSize || (uint64_t)sheet.firstSprite + sheet.spriteCount > header->spriteCount)
+                    throw std::runtime_error("Broken .bin sheet record");
+            }
+            for (uint32_t s = 0; s < header->spriteCount; s++) {
+                const SpriteRecord& sprite = sprites[s];
+                if ((uint64_t)sprite.name + sprite.nameLength >= header->stringsSize || sprite.extension >= header->stringsSize || sprite.sheet >= header->sheetCount)
+                    throw std::runtime_error("Broken .bin sprite record");
+                if (sheetSprites[s] >= header->spriteCount) throw std::runtime_error("Broken .bin sheet sprites");
+            }
+        }
+
+        BinarySpritesheetReader::Sheet BinarySpritesheetReader::GetSheet(size_t index) const
+        {
+            if (index >= header->sheetCount) throw std::out_of_range("No sheet " + std::to_string(index) + " in the .bin file");
+            const BinaryMetadata::SheetRecord& record = sheets[index];
+            Sheet sheet;
+            sheet.texture = strings + record.texture;
+            sheet.width = record.width;
+            sheet.height = record.height;
+            sheet.sprites = { sheetSprites + record.firstSprite, record.spriteCount };
+            return sheet;
+        }
+        const BinaryMetadata::SpriteRecord* BinarySpritesheetReader::Find(std::string_view name) const
+        {
+            using namespace BinaryMetadata;
+            if (header->indexedCount == 0) return nullptr;
+            // any name maps to some record, the hash and then the name tell whether it's the one
+            const uint64_t hash = NameHash(name, header->hashSeed);
+            const SpriteRecord& sprite = sprites[SlotOf(hash, pilots[BucketOf(hash, header->bucketCount)], header->indexedCount)];
+            return sprite.nameHash == hash && Name(sprite) == name ? &sprite : nullptr;
+        }
+        SpriteInfo BinarySpritesheetReader::ToSpriteInfo(const SpriteRecord& sprite) const
+        {
+            SpriteInfo info;
+            info.name = Name(sprite);
+            info.extension = Extension(sprite);
+            info.position = { sprite.x, sprite.y };
+            info.size = { sprite.width, sprite.height };
+            info.pivot = { sprite.pivotX, sprite.pivotY };
+            info.sourceSize = { sprite.sourceWidth, sprite.sourceHeight };
+            info.sourceOffset = { sprite.offsetX, sprite.offsetY };
+            return info;
+        }
+    }
+}
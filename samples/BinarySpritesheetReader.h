@@ -0,0 +1,71 @@
+#pragma once
+#include "Spritesheet.h"
+#include "../src/BinaryMetadata.h"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * Reads the .bin written with -meta=bin in place. the file is mapped into memory and the records
+        * are handed out as they are stored, so opening it allocates nothing per sprite
+        * the file is checked once when opened. throws std::runtime_error if it's missing or broken
+        *
+        * Find looks a name up in the perfect hash stored in the file, which reads one pilot and one
+        * sprite record, a single cache line
+        */
+        class BinarySpritesheetReader {
+        public:
+            using SpriteRecord = BinaryMetadata::SpriteRecord;
+            struct Sheet {
+                // file name of the .png, next to the .bin
+                std::string_view texture;
+                uint32_t width = 0, height = 0;
+                // indices for Sprite, in the order of the .json
+                std::span<const uint32_t> sprites;
+            };
+        private:
+            const uint8_t* data = nullptr;
+            size_t size = 0;
+#if defined(_WIN32) || defined(_WIN64)
+            void* file = nullptr;
+            void* mapping = nullptr;
+#endif
+            const BinaryMetadata::Header* header = nullptr;
+            const BinaryMetadata::SheetRecord* sheets = nullptr;
+            const SpriteRecord* sprites = nullptr;
+            const uint32_t* sheetSprites = nullptr;
+            const uint32_t* pilots = nullptr;
+            const char* strings = nullptr;
+
+            void validate();
+            void close();
+        public:
+            explicit BinarySpritesheetReader(const std::string& filePathBin);
+            ~BinarySpritesheetReader();
+            BinarySpritesheetReader(const BinarySpritesheetReader&) = delete;
+            BinarySpritesheetReader& operator=(const BinarySpritesheetReader&) = delete;
+
+            std::string_view Group() const { return strings + header->group; }
+            bool IsTrimmed() const { return (header->flags & BinaryMetadata::FlagTrimmed) != 0; }
+
+            size_t SheetCount() const { return header->sheetCount; }
+            Sheet GetSheet(size_t index) const;
+            // every sprite of every sheet, in the order of the name index
+            std::span<const SpriteRecord> Sprites() const { return { sprites, header->spriteCount }; }
+            const SpriteRecord& Sprite(uint32_t index) const { return sprites[index]; }
+            /*
+            * the sprite with this name, nullptr if there is none. sprite->sheet is the index of its sheet
+            * with the same name in several folders, the first one packed is found
+            */
+            const SpriteRecord* Find(std::string_view name) const;
+
+            std::string_view Name(const SpriteRecord& sprite) const { return { strings + sprite.name, sprite.nameLength }; }
+            std::string_view Extension(const SpriteRecord& sprite) const { return strings + sprite.extension; }
+            // copies the record into a SpriteInfo, for code written against Spritesheet
+            SpriteInfo ToSpriteInfo(const SpriteRecord& sprite) const;
+        };
+    }
+}
@@ -18,6 +18,10 @@ namespace QLE {
             ImageSize size;
             // used to adjust the image within your custom tool
             Pivot pivot;
+            // size of the image before its transparent borders were trimmed. same as size if it wasn't trimmed
+            ImageSize sourceSize;
+            // where the trimmed image starts within its original size
+            Position sourceOffset;
         };
         class Spritesheet {
         public:
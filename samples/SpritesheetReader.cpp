@@ -10,6 +10,96 @@ namespace QLE {
         using std::cout;
         using std::cerr;
         using std::endl;
+
+        namespace {
+            /*
+            * fills the Spritesheet while the JSON is parsed, without building a DOM of it first
+            * depth 1 is the sheet, 2 the "sprites" array, 3 a sprite and 4 an object in it like "position"
+            */
+            class SpritesheetSaxHandler : public nlohmann::json_sax<nlohmann::json> {
+            private:
+                Spritesheet& sheet;
+                int depth = 0;
+                bool inSprites = false;
+                bool hasSourceSize = false;
+                std::string rootKey, spriteKey;
+                // the field the next number goes to, set by the key before it
+                int* intField = nullptr;
+                float* floatField = nullptr;
+
+                bool setNumber(double value) {
+                    if (intField) *intField = (int)value;
+                    else if (floatField) *floatField = (float)value;
+                    return true;
+                }
+                void findField(const std::string& member) {
+                    SpriteInfo& sprite = sheet.spriteInfos.back();
+                    const bool isX = member == "x", isY = member == "y";
+                    const bool isWidth = member == "width", isHeight = member == "height";
+                    if (spriteKey == "position") intField = isX ? &sprite.position.x : isY ? &sprite.position.y : nullptr;
+                    else if (spriteKey == "size") intField = isWidth ? &sprite.size.width : isHeight ? &sprite.size.height : nullptr;
+                    else if (spriteKey == "pivot") floatField = isX ? &sprite.pivot.x : isY ? &sprite.pivot.y : nullptr;
+                    else if (spriteKey == "sourceSize") intField = isWidth ? &sprite.sourceSize.width : isHeight ? &sprite.sourceSize.height : nullptr;
+                    else if (spriteKey == "spriteSourceOffset") intField = isX ? &sprite.sourceOffset.x : isY ? &sprite.sourceOffset.y : nullptr;
+                }
+            public:
+                std::string error;
+                explicit SpritesheetSaxHandler(Spritesheet& sheet) : sheet(sheet) {}
+
+                bool null() override { return true; }
+                bool boolean(bool) override { return true; }
+                bool number_integer(number_integer_t value) override { return setNumber((double)value); }
+                bool number_unsigned(number_unsigned_t value) override { return setNumber((double)value); }
+                bool number_float(number_float_t value, const string_t&) override { return setNumber(value); }
+                bool binary(binary_t&) override { return true; }
+                bool string(string_t& value) override {
+                    if (depth == 1 && rootKey == "texture") sheet.texture = std::move(value);
+                    else if (depth == 1 && rootKey == "group") sheet.group = std::move(value);
+                    else if (inSprites && depth == 3 && spriteKey == "name") sheet.spriteInfos.back().name = std::move(value);
+                    else if (inSprites && depth == 3 && spriteKey == "extension") sheet.spriteInfos.back().extension = std::move(value);
+                    return true;
+                }
+                bool key(string_t& value) override {
+                    intField = nullptr;
+                    floatField = nullptr;
+                    if (depth == 1) rootKey = std::move(value);
+                    else if (inSprites && depth == 3) spriteKey = std::move(value);
+                    else if (inSprites && depth == 4) findField(value);
+                    return true;
+                }
+                bool start_object(std::size_t) override {
+                    depth++;
+                    if (inSprites && depth == 3) {
+                        sheet.spriteInfos.emplace_back();
+                        hasSourceSize = false;
+                    }
+                    else if (inSprites && depth == 4 && spriteKey == "sourceSize") hasSourceSize = true;
+                    return true;
+                }
+                bool end_object() override {
+                    // sprites that weren't trimmed have the size they were packed with
+                    if (inSprites && depth == 3 && !hasSourceSize) sheet.spriteInfos.back().sourceSize = sheet.spriteInfos.back().size;
+                    depth--;
+                    intField = nullptr;
+                    floatField = nullptr;
+                    return true;
+                }
+                bool start_array(std::size_t) override {
+                    depth++;
+                    if (depth == 2 && rootKey == "sprites") inSprites = true;
+                    return true;
+                }
+                bool end_array() override {
+                    if (depth == 2) inSprites = false;
+                    depth--;
+                    return true;
+                }
+                bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) override {
+                    error = e.what();
+                    return false;
+                }
+            };
+        }
         std::vector<Spritesheet> SpritesheetReader::ReadFromPath(std::string folderPath)
         {
             std::vector<Spritesheet> sheets;
@@ -42,34 +132,22 @@ namespace QLE {
             if(!fs::is_regular_file(filePathPng))
                 throw std::runtime_error("Failed to read spritesheet: " + filePathPng);
             
-            // Load the JSON file
-            std::ifstream inputFile(filePathJson);
+            // Load the JSON file. parsing from memory is much faster than from the stream
+            std::ifstream inputFile(filePathJson, std::ios::binary | std::ios::ate);
             if (!inputFile.is_open()) {
                 throw std::runtime_error("Failed to open JSON file when reading the spritesheet: " + filePathJson);
             }
-            nlohmann::json jsonInput;
-            inputFile >> jsonInput;
+            std::string text((size_t)inputFile.tellg(), '\0');
+            inputFile.seekg(0);
+            inputFile.read(text.data(), (std::streamsize)text.size());
             inputFile.close();
 
             Spritesheet sheet;
-            sheet.group = jsonInput["group"];
-            sheet.texture = jsonInput["texture"];
-            
-            for (const auto& sprite : jsonInput["sprites"]) {
-                SpriteInfo spriteInfo;
-                spriteInfo.name = sprite["name"];
-                spriteInfo.extension = sprite["extension"];
-                spriteInfo.position.x = sprite["position"]["x"];
-                spriteInfo.position.y = sprite["position"]["y"];
-                spriteInfo.size.width = sprite["size"]["width"];
-                spriteInfo.size.height = sprite["size"]["height"];
-                spriteInfo.pivot.x = sprite["pivot"]["x"];
-                spriteInfo.pivot.y = sprite["pivot"]["y"];
-
-                // TODO: implement how you're going to load the sprite
+            SpritesheetSaxHandler handler(sheet);
+            if (!nlohmann::json::sax_parse(text, &handler))
+                throw std::runtime_error("Failed to parse JSON file when reading the spritesheet: " + filePathJson + ". " + handler.error);
 
-                sheet.spriteInfos.push_back(spriteInfo);
-            }
+            // TODO: implement how you're going to load the sprites
             return sheet;
         }
     }
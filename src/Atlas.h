@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        // An image handed to TexturePacker::PackAtlas. either its RGBA pixels or an encoded file held in memory
+        struct AtlasImage {
+            // only reported back in the sprites and in errors, doesn't have to be unique
+            std::string name;
+            // width * height * 4 bytes of RGBA, rows without padding. used when set
+            const uint8_t* pixels = nullptr;
+            int width = 0, height = 0;
+            // a .png, .jpg, .bmp or .tga file, decoded when there are no pixels
+            std::span<const uint8_t> encoded;
+        };
+        // Where an image went
+        struct AtlasSprite {
+            std::string name;
+            // position of the image in the list given to PackAtlas
+            int image = 0;
+            int sheet = 0;
+            // the rect in the sheet, trimmed when trimming
+            int x = 0, y = 0, width = 0, height = 0;
+            // size of the image before trimming and where the trimmed area starts within it
+            int sourceWidth = 0, sourceHeight = 0;
+            int offsetX = 0, offsetY = 0;
+
+            inline bool IsTrimmed() const { return width != sourceWidth || height != sourceHeight; }
+        };
+        struct AtlasSheet {
+            int width = 0, height = 0;
+            // RGBA, width * height * 4 bytes
+            std::vector<uint8_t> pixels;
+            // the encoded .png, only when asked for
+            std::vector<uint8_t> png;
+            // palette size when the sheet was quantized for the .png
+            int colors = 0;
+        };
+        struct Atlas {
+            std::vector<AtlasSheet> sheets;
+            // one per image in the order they were given, copies packed once by dedup included
+            std::vector<AtlasSprite> sprites;
+        };
+    }
+}
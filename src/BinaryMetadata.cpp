@@ -0,0 +1,205 @@
+#include "BinaryMetadata.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+
+namespace QLE {
+    namespace TextureTools {
+        namespace BinaryMetadata {
+            // written a byte at a time, so the file is little endian on any machine
+            static void putU32(std::vector<uint8_t>& file, size_t at, uint32_t value) {
+                for (int i = 0; i < 4; i++) file[at + i] = (uint8_t)(value >> (i * 8));
+            }
+            static uint32_t getU32(const std::vector<uint8_t>& file, size_t at) {
+                uint32_t value = 0;
+                for (int i = 0; i < 4; i++) value |= (uint32_t)file[at + i] << (i * 8);
+                return value;
+            }
+            static void putU64(std::vector<uint8_t>& file, size_t at, uint64_t value) {
+                putU32(file, at, (uint32_t)value);
+                putU32(file, at + 4, (uint32_t)(value >> 32));
+            }
+            static uint32_t aligned(size_t offset, size_t alignment = Alignment) {
+                return (uint32_t)((offset + alignment - 1) / alignment * alignment);
+            }
+
+            uint32_t Writer::addString(const std::string& text) {
+                auto found = stringOffsets.find(text);
+                if (found != stringOffsets.end()) return found->second;
+                uint32_t offset = (uint32_t)strings.size();
+                strings += text;
+                strings += '\0';
+                stringOffsets.emplace(text, offset);
+                return offset;
+            }
+            void Writer::AddSheet(const std::string& texture, int width, int height) {
+                SheetRecord sheet = {};
+                sheet.texture = addString(texture);
+                sheet.width = (uint32_t)width;
+                sheet.height = (uint32_t)height;
+                sheet.firstSprite = (uint32_t)sprites.size();
+                sheets.push_back(sheet);
+            }
+            void Writer::AddSprite(const std::string& name, const std::string& extension, int x, int y, int width, int height,
+                int sourceWidth, int sourceHeight, int offsetX, int offsetY, float pivotX, float pivotY) {
+                if (sheets.empty()) throw std::runtime_error("A sprite was added before its sheet");
+                SpriteRecord sprite = {};
+                sprite.name = addString(name);
+                sprite.nameLength = (uint32_t)name.size();
+                sprite.extension = addString(extension);
+                sprite.sheet = (uint32_t)sheets.size() - 1;
+                sprite.x = x;
+                sprite.y = y;
+                sprite.width = width;
+                sprite.height = height;
+                sprite.sourceWidth = sourceWidth;
+                sprite.sourceHeight = sourceHeight;
+                sprite.offsetX = offsetX;
+                sprite.offsetY = offsetY;
+                sprite.pivotX = pivotX;
+                sprite.pivotY = pivotY;
+                sprites.push_back(sprite);
+                sheets.back().spriteCount++;
+            }
+            bool Writer::buildIndex(const std::vector<uint64_t>& hashes, uint32_t bucketCount, std::vector<uint32_t>& pilots, std::vector<uint32_t>& slots) {
+                const uint32_t count = (uint32_t)hashes.size();
+                // two names with the same hash land on the same slot whatever the pilot
+                std::vector<uint64_t> sorted(hashes);
+                std::sort(sorted.begin(), sorted.end());
+                if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) return false;
+
+                std::vector<std::vector<uint32_t>> buckets(bucketCount);
+                for (uint32_t i = 0; i < count; i++) buckets[BucketOf(hashes[i], bucketCount)].push_back(i);
+                // the largest buckets go first, while most slots are still free
+                std::vector<uint32_t> order(bucketCount);
+                std::iota(order.begin(), order.end(), 0);
+                std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+                pilots.assign(bucketCount, 0);
+                slots.assign(count, 0);
+                std::vector<bool> taken(count, false);
+                std::vector<uint32_t> candidate;
+                // the last buckets have a single free slot left, which takes about count tries to hit
+                const uint64_t pilotLimit = std::min<uint64_t>((uint64_t)count * 64 + 1024, UINT32_MAX);
+                for (uint32_t b : order) {
+                    const std::vector<uint32_t>& keys = buckets[b];
+                    if (keys.empty()) break;
+                    uint32_t pilot = 0;
+                    for (;; pilot++) {
+                        if (pilot >= pilotLimit) return false;
+                        candidate.clear();
+                        for (uint32_t key : keys) {
+                            const uint32_t slot = SlotOf(hashes[key], pilot, count);
+                            if (taken[slot] || std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) break;
+                            candidate.push_back(slot);
+                        }
+                        if (candidate.size() == keys.size()) break;
+                    }
+                    pilots[b] = pilot;
+                    for (size_t k = 0; k < keys.size(); k++) {
+                        taken[candidate[k]] = true;
+                        slots[keys[k]] = candidate[k];
+                    }
+                }
+                return true;
+            }
+            std::vector<uint8_t> Writer::Encode(const std::string& group, bool trimmed) const {
+                // the group goes at the end of the table, after every string the records point at
+                std::string table = strings;
+                uint32_t groupOffset = (uint32_t)table.size();
+                table += group;
+                table += '\0';
+
+                // equal names share their string, only the first sprite of a name is indexed
+                std::vector<uint32_t> indexed, repeated;
+                std::unordered_set<uint32_t> seenNames;
+                for (uint32_t s = 0; s < (uint32_t)sprites.size(); s++) (seenNames.insert(sprites[s].name).second ? indexed : repeated).push_back(s);
+                auto nameOf = [&](const SpriteRecord& sprite) { return std::string_view(strings.data() + sprite.name, sprite.nameLength); };
+
+                // about four names per bucket keeps the pilots small and quick to find
+                const uint32_t bucketCount = std::max<uint32_t>(1, ((uint32_t)indexed.size() + 3) / 4);
+                std::vector<uint64_t> hashes(indexed.size());
+                std::vector<uint32_t> pilots, slots;
+                uint32_t seed = 0;
+                for (;; seed++) {
+                    for (size_t i = 0; i < indexed.size(); i++) hashes[i] = NameHash(nameOf(sprites[indexed[i]]), seed);
+                    if (buildIndex(hashes, bucketCount, pilots, slots)) break;
+                }
+                // records by slot, then the repeated names in the order they were added
+                std::vector<uint32_t> order(sprites.size()), position(sprites.size());
+                for (size_t i = 0; i < indexed.size(); i++) order[slots[i]] = indexed[i];
+                std::copy(repeated.begin(), repeated.end(), order.begin() + indexed.size());
+                for (uint32_t r = 0; r < (uint32_t)order.size(); r++) position[order[r]] = r;
+
+                const uint32_t sheetsOffset = aligned(sizeof(Header));
+                const uint32_t sheetSpritesOffset = aligned(sheetsOffset + sheets.size() * sizeof(SheetRecord));
+                const uint32_t pilotsOffset = aligned(sheetSpritesOffset + sprites.size() * sizeof(uint32_t));
+                const uint32_t spritesOffset = aligned(pilotsOffset + pilots.size() * sizeof(uint32_t), SpriteAlignment);
+                const uint32_t stringsOffset = aligned(spritesOffset + sprites.size() * sizeof(SpriteRecord));
+                const uint32_t fileSize = aligned(stringsOffset + table.size());
+                std::vector<uint8_t> file(fileSize, 0);
+
+                std::memcpy(file.data(), Magic, sizeof(Magic));
+                const uint32_t header[] = { Version, fileSize, (uint32_t)sheets.size(), (uint32_t)sprites.size(),
+                    sheetsOffset, spritesOffset, stringsOffset, (uint32_t)table.size(), groupOffset, trimmed ? FlagTrimmed : 0,
+                    sheetSpritesOffset, (uint32_t)indexed.size(), bucketCount, pilotsOffset, seed };
+                for (size_t i = 0; i < std::size(header); i++) putU32(file, offsetof(Header, version) + i * 4, header[i]);
+
+                for (size_t s = 0; s < sheets.size(); s++) {
+                    const SheetRecord& sheet = sheets[s];
+                    const uint32_t fields[] = { sheet.texture, sheet.width, sheet.height, sheet.firstSprite, sheet.spriteCount, 0 };
+                    for (size_t i = 0; i < std::size(fields); i++) putU32(file, sheetsOffset + s * sizeof(SheetRecord) + i * 4, fields[i]);
+                }
+                // the sprites were added sheet by sheet, so the sheet ranges stay as they are
+                for (size_t s = 0; s < sprites.size(); s++) putU32(file, sheetSpritesOffset + s * sizeof(uint32_t), position[s]);
+                for (size_t b = 0; b < pilots.size(); b++) putU32(file, pilotsOffset + b * sizeof(uint32_t), pilots[b]);
+                for (size_t r = 0; r < order.size(); r++) {
+                    const SpriteRecord& sprite = sprites[order[r]];
+                    const size_t record = spritesOffset + r * sizeof(SpriteRecord);
+                    const uint32_t fields[] = { sprite.name, sprite.nameLength, sprite.extension, sprite.sheet,
+                        (uint32_t)sprite.x, (uint32_t)sprite.y, (uint32_t)sprite.width, (uint32_t)sprite.height,
+                        (uint32_t)sprite.sourceWidth, (uint32_t)sprite.sourceHeight, (uint32_t)sprite.offsetX, (uint32_t)sprite.offsetY,
+                        std::bit_cast<uint32_t>(sprite.pivotX), std::bit_cast<uint32_t>(sprite.pivotY) };
+                    for (size_t i = 0; i < std::size(fields); i++) putU32(file, record + i * 4, fields[i]);
+                    putU64(file, record + offsetof(SpriteRecord, nameHash), NameHash(nameOf(sprite), seed));
+                }
+                std::memcpy(file.data() + stringsOffset, table.data(), table.size());
+                return file;
+            }
+
+            size_t SetPivots(std::vector<uint8_t>& file, const std::unordered_map<std::string, std::pair<float, float>>& pivots) {
+                if (file.size() < sizeof(Header) || std::memcmp(file.data(), Magic, sizeof(Magic)) != 0)
+                    throw std::runtime_error("Not a TexturePacker .bin file");
+                if (getU32(file, offsetof(Header, version)) != Version)
+                    throw std::runtime_error("Unsupported .bin version " + std::to_string(getU32(file, offsetof(Header, version))));
+                const uint64_t spriteCount = getU32(file, offsetof(Header, spriteCount));
+                const uint64_t spritesOffset = getU32(file, offsetof(Header, spritesOffset));
+                const uint64_t stringsOffset = getU32(file, offsetof(Header, stringsOffset));
+                const uint64_t stringsSize = getU32(file, offsetof(Header, stringsSize));
+                if (spritesOffset + spriteCount * sizeof(SpriteRecord) > file.size() || stringsOffset + stringsSize > file.size())
+                    throw std::runtime_error("Truncated .bin file");
+
+                size_t changed = 0;
+                // names are looked up with views into the table, no string is made per sprite
+                std::unordered_map<std::string_view, std::pair<float, float>> byName(pivots.begin(), pivots.end());
+                for (uint64_t s = 0; s < spriteCount; s++) {
+                    const size_t record = (size_t)(spritesOffset + s * sizeof(SpriteRecord));
+                    const uint32_t name = getU32(file, record + offsetof(SpriteRecord, name));
+                    const uint32_t nameLength = getU32(file, record + offsetof(SpriteRecord, nameLength));
+                    if ((uint64_t)name + nameLength > stringsSize) throw std::runtime_error("Broken sprite name in .bin file");
+                    auto found = byName.find(std::string_view((const char*)file.data() + stringsOffset + name, nameLength));
+                    if (found == byName.end()) continue;
+                    putU32(file, record + offsetof(SpriteRecord, pivotX), std::bit_cast<uint32_t>(found->second.first));
+                    putU32(file, record + offsetof(SpriteRecord, pivotY), std::bit_cast<uint32_t>(found->second.second));
+                    changed++;
+                }
+                return changed;
+            }
+        }
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * The .bin written next to the sheets with -meta=bin, one per group
+        * little endian. the file starts with a Header, followed by the sheet records, the sprite indices of every sheet,
+        * the pilots of the name index, the sprite records and the string table, each starting on an 8 byte boundary
+        * and the sprite records on a 64 byte one. strings are referenced by their offset in the table and end with
+        * a zero byte. every record has a fixed size, so the file can be mapped and read in place
+        *
+        * the sprite records are in the order of a minimal perfect hash of their names (hash and displace):
+        * a name goes to bucket BucketOf(hash), whose pilot moves it to the record SlotOf(hash, pilot)
+        * the records of names seen before in the group come after the indexed ones
+        */
+        namespace BinaryMetadata {
+            const char Magic[4] = { 'T', 'P', 'M', 'D' };
+            // bumped whenever the layout of the file changes
+            constexpr uint32_t Version = 2;
+            constexpr uint32_t Alignment = 8;
+            // a sprite record is one cache line
+            constexpr uint32_t SpriteAlignment = 64;
+
+            struct Header {
+                char magic[4];
+                uint32_t version;
+                // size of the whole file
+                uint32_t fileSize;
+                uint32_t sheetCount;
+                uint32_t spriteCount;
+                uint32_t sheetsOffset;
+                uint32_t spritesOffset;
+                uint32_t stringsOffset;
+                uint32_t stringsSize;
+                // string, the group of the sheets
+                uint32_t group;
+                // set when the sprites were trimmed
+                uint32_t flags;
+                // uint32 sprite indices, the sprites of a sheet one after the other
+                uint32_t sheetSpritesOffset;
+                // the first indexedCount sprite records can be found by name
+                uint32_t indexedCount;
+                uint32_t bucketCount;
+                // uint32 per bucket
+                uint32_t pilotsOffset;
+                uint32_t hashSeed;
+            };
+            constexpr uint32_t FlagTrimmed = 1;
+
+            struct SheetRecord {
+                // string, file name of the .png next to the .bin
+                uint32_t texture;
+                uint32_t width, height;
+                // range of the sheet sprite indices, in the order of the .json
+                uint32_t firstSprite, spriteCount;
+                uint32_t reserved;
+            };
+            struct SpriteRecord {
+                // strings, the file name and extension the sprite was packed from
+                uint32_t name, nameLength;
+                uint32_t extension;
+                uint32_t sheet;
+                // the rect in the sheet, trimmed when trimming
+                int32_t x, y, width, height;
+                // size of the image before trimming and where the trimmed area starts within it
+                int32_t sourceWidth, sourceHeight;
+                int32_t offsetX, offsetY;
+                float pivotX, pivotY;
+                // NameHash of the name, so a missing name is told apart without reading the string
+                uint64_t nameHash;
+            };
+            static_assert(sizeof(Header) == 64, "the header is part of the file format");
+            static_assert(sizeof(SheetRecord) == 24, "sheet records are part of the file format");
+            static_assert(sizeof(SpriteRecord) == SpriteAlignment, "sprite records are part of the file format");
+
+            // FNV-1a with a final mix, the same on every machine
+            inline uint64_t NameHash(std::string_view name, uint32_t seed) {
+                uint64_t hash = 14695981039346656037ull ^ seed;
+                for (unsigned char c : name) {
+                    hash ^= c;
+                    hash *= 1099511628211ull;
+                }
+                hash ^= hash >> 33;
+                hash *= 0xFF51AFD7ED558CCDull;
+                hash ^= hash >> 33;
+                hash *= 0xC4CEB9FE1A85EC53ull;
+                return hash ^ (hash >> 33);
+            }
+            inline uint32_t BucketOf(uint64_t hash, uint32_t bucketCount) {
+                return (uint32_t)((hash >> 32) % bucketCount);
+            }
+            inline uint32_t SlotOf(uint64_t hash, uint32_t pilot, uint32_t indexedCount) {
+                uint64_t slot = hash ^ ((uint64_t)pilot * 0x9E3779B97F4A7C15ull);
+                slot ^= slot >> 29;
+                slot *= 0xBF58476D1CE4E5B9ull;
+                return (uint32_t)((slot ^ (slot >> 32)) % indexedCount);
+            }
+
+            // Lays out the records and strings of a file
+            class Writer {
+            private:
+                std::vector<SheetRecord> sheets;
+                // in the order they were added
+                std::vector<SpriteRecord> sprites;
+                std::string strings;
+                // each string is stored once
+                std::unordered_map<std::string, uint32_t> stringOffsets;
+                uint32_t addString(const std::string& text);
+                /*
+                * finds the pilot of every bucket so the unique names land on distinct slots
+                * returns false if seed gives two names the same hash or a bucket runs out of pilots
+                */
+                static bool buildIndex(const std::vector<uint64_t>& hashes, uint32_t bucketCount, std::vector<uint32_t>& pilots, std::vector<uint32_t>& slots);
+            public:
+                // sheets have to be added in order, each followed by its sprites
+                void AddSheet(const std::string& texture, int width, int height);
+                void AddSprite(const std::string& name, const std::string& extension, int x, int y, int width, int height,
+                    int sourceWidth, int sourceHeight, int offsetX, int offsetY, float pivotX = .5f, float pivotY = .5f);
+                std::vector<uint8_t> Encode(const std::string& group, bool trimmed) const;
+            };
+            // sets the pivot of every sprite named in pivots. returns how many were changed. throws std::runtime_error on a broken file
+            size_t SetPivots(std::vector<uint8_t>& file, const std::unordered_map<std::string, std::pair<float, float>>& pivots);
+        }
+    }
+}
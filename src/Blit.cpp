@@ -0,0 +1,131 @@
+#include "Blit.h"
+#include <cstring>
+
+// SSE2 is always there on x64, NEON on arm64. everything else uses the portable path
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TP_BLIT_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define TP_BLIT_NEON
+#include <arm_neon.h>
+#endif
+
+namespace QLE {
+    namespace TextureTools {
+        namespace Blit {
+            // little endian RGBA, alpha is the highest byte of each pixel
+            const uint32_t AlphaMask = 0xFF000000u;
+
+            void CopyRect(uint8_t* dst, int dstWidth, int dstX, int dstY,
+                const uint8_t* src, int srcWidth, int srcX, int srcY, int width, int height)
+            {
+                if (width <= 0 || height <= 0) return;
+                const size_t dstStride = (size_t)dstWidth * BytesPerPixel;
+                const size_t srcStride = (size_t)srcWidth * BytesPerPixel;
+                const size_t rowBytes = (size_t)width * BytesPerPixel;
+                uint8_t* dstRow = dst + (size_t)dstY * dstStride + (size_t)dstX * BytesPerPixel;
+                const uint8_t* srcRow = src + (size_t)srcY * srcStride + (size_t)srcX * BytesPerPixel;
+
+                // whole rows on both sides are one contiguous block
+                if (rowBytes == dstStride && rowBytes == srcStride) {
+                    std::memcpy(dstRow, srcRow, rowBytes * height);
+                    return;
+                }
+                for (int y = 0; y < height; y++, dstRow += dstStride, srcRow += srcStride)
+                    std::memcpy(dstRow, srcRow, rowBytes);
+            }
+
+            void FillAlpha(uint8_t* pixels, size_t pixelCount, uint8_t alpha)
+            {
+                size_t i = 0;
+#if defined(TP_BLIT_SSE2)
+                const __m128i mask = _mm_set1_epi32((int)AlphaMask);
+                const __m128i value = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+                for (; i + 4 <= pixelCount; i += 4) {
+                    __m128i* p = (__m128i*)(pixels + i * BytesPerPixel);
+                    __m128i color = _mm_andnot_si128(mask, _mm_loadu_si128(p));
+                    _mm_storeu_si128(p, _mm_or_si128(color, value));
+                }
+#elif defined(TP_BLIT_NEON)
+                const uint8x16_t mask = vreinterpretq_u8_u32(vdupq_n_u32(AlphaMask));
+                const uint8x16_t value = vreinterpretq_u8_u32(vdupq_n_u32((uint32_t)alpha << 24));
+                for (; i + 4 <= pixelCount; i += 4) {
+                    uint8_t* p = pixels + i * BytesPerPixel;
+                    vst1q_u8(p, vbslq_u8(mask, value, vld1q_u8(p)));
+                }
+#endif
+                for (; i < pixelCount; i++) pixels[i * BytesPerPixel + 3] = alpha;
+            }
+
+            bool RowHasAlpha(const uint8_t* row, int width)
+            {
+                int x = 0;
+#if defined(TP_BLIT_SSE2)
+                const __m128i mask = _mm_set1_epi32((int)AlphaMask);
+                const __m128i zero = _mm_setzero_si128();
+                for (; x + 4 <= width; x += 4) {
+                    __m128i alpha = _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + x * BytesPerPixel)), mask);
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, zero)) != 0xFFFF) return true;
+                }
+#elif defined(TP_BLIT_NEON)
+                const uint8x16_t mask = vreinterpretq_u8_u32(vdupq_n_u32(AlphaMask));
+                for (; x + 4 <= width; x += 4) {
+                    uint64x2_t alpha = vreinterpretq_u64_u8(vandq_u8(vld1q_u8(row + x * BytesPerPixel), mask));
+                    if ((vgetq_lane_u64(alpha, 0) | vgetq_lane_u64(alpha, 1)) != 0) return true;
+                }
+#endif
+                for (; x < width; x++)
+                    if (row[x * BytesPerPixel + 3] != 0) return true;
+                return false;
+            }
+
+            bool FindAlphaBounds(const uint8_t* pixels, int width, int height, int& x, int& y, int& boundsWidth, int& boundsHeight)
+            {
+                const size_t stride = (size_t)width * BytesPerPixel;
+
+                // rows first, then only the remaining rows are scanned for the columns
+                int top = 0, bottom = height - 1;
+                while (top <= bottom && !RowHasAlpha(pixels + top * stride, width)) top++;
+                if (top > bottom) return false;
+                while (!RowHasAlpha(pixels + bottom * stride, width)) bottom--;
+
+                int left = width, right = -1;
+                for (int row = top; row <= bottom; row++) {
+                    const uint8_t* line = pixels + row * stride;
+                    // only the columns outside the current bounds can still move them
+                    if (left > 0 && RowHasAlpha(line, left)) {
+                        for (int col = 0; col < left; col++) {
+                            if (line[col * BytesPerPixel + 3] == 0) continue;
+                            left = col;
+                            break;
+                        }
+                    }
+                    if (right < width - 1 && RowHasAlpha(line + (right + 1) * BytesPerPixel, width - right - 1)) {
+                        for (int col = width - 1; col > right; col--) {
+                            if (line[col * BytesPerPixel + 3] == 0) continue;
+                            right = col;
+                            break;
+                        }
+                    }
+                }
+
+                x = left;
+                y = top;
+                boundsWidth = right - left + 1;
+                boundsHeight = bottom - top + 1;
+                return true;
+            }
+
+            const char* InstructionSet()
+            {
+#if defined(TP_BLIT_SSE2)
+                return "SSE2";
+#elif defined(TP_BLIT_NEON)
+                return "NEON";
+#else
+                return "scalar";
+#endif
+            }
+        }
+    }
+}
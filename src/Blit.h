@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace QLE {
+    namespace TextureTools {
+        // Pixel operations on tightly packed RGBA buffers. widths and positions are in pixels
+        namespace Blit {
+            const int BytesPerPixel = 4;
+
+            // copies a width x height block from src to dst one row at a time
+            void CopyRect(uint8_t* dst, int dstWidth, int dstX, int dstY,
+                const uint8_t* src, int srcWidth, int srcX, int srcY, int width, int height);
+            // sets the alpha of every pixel, keeping the colors
+            void FillAlpha(uint8_t* pixels, size_t pixelCount, uint8_t alpha);
+            // true if any pixel in the row has a non zero alpha
+            bool RowHasAlpha(const uint8_t* row, int width);
+            /*
+            * finds the smallest rect holding every pixel with a non zero alpha
+            * returns false if the whole image is transparent
+            */
+            bool FindAlphaBounds(const uint8_t* pixels, int width, int height, int& x, int& y, int& boundsWidth, int& boundsHeight);
+
+            // name of the instruction set the kernels were built with
+            const char* InstructionSet();
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace QLE {
+    namespace TextureTools {
+        // Queue handing work from one pipeline stage to the next
+        template<typename T>
+        class BlockingQueue
+        {
+        private:
+            std::deque<T> items;
+            std::mutex mutex;
+            std::condition_variable available;
+            bool closed = false;
+        public:
+            void Push(T item) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    items.push_back(std::move(item));
+                }
+                available.notify_one();
+            }
+            // waits for the next item. returns false once the queue is closed and empty
+            bool Pop(T& item) {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this] { return closed || !items.empty(); });
+                if (items.empty()) return false;
+                item = std::move(items.front());
+                items.pop_front();
+                return true;
+            }
+            // no more items will be pushed
+            void Close() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    closed = true;
+                }
+                available.notify_all();
+            }
+        };
+    }
+}
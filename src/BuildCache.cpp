@@ -0,0 +1,113 @@
+#include "BuildCache.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include "Hash.h"
+
+namespace fs = std::filesystem;
+
+namespace QLE {
+    namespace TextureTools {
+        // folders being filled start with this, they're never read as entries
+        static const std::string TemporaryPrefix = "tmp-";
+        // a temporary folder this old belongs to a build that died while inserting
+        static const auto AbandonedAge = std::chrono::hours(24);
+
+        BuildCache::BuildCache(fs::path directory, uintmax_t maxBytes) : directory(std::move(directory)), maxBytes(maxBytes)
+        {
+            fs::create_directories(this->directory);
+        }
+        fs::path BuildCache::entryPath(const std::string& key) const
+        {
+            return directory / key;
+        }
+        std::string BuildCache::MakeKey(const std::string& text)
+        {
+            std::ostringstream key;
+            key << std::hex << std::setfill('0')
+                << std::setw(16) << Hash64(text.data(), text.size(), 0)
+                << std::setw(16) << Hash64(text.data(), text.size(), 1);
+            return key.str();
+        }
+
+        bool BuildCache::Restore(const std::string& key, const fs::path& outputDir, bool hardLinks, std::vector<fs::path>& restored)
+        {
+            const fs::path entry = entryPath(key);
+            std::error_code error;
+            if (!fs::is_directory(entry, error)) return false;
+
+            restored.clear();
+            for (const auto& file : fs::directory_iterator(entry, error)) {
+                if (!file.is_regular_file()) continue;
+                fs::path target = outputDir / file.path().filename();
+                fs::remove(target, error);
+                bool linked = false;
+                if (hardLinks) {
+                    fs::create_hard_link(file.path(), target, error);
+                    linked = !error;
+                }
+                // another build may be trimming the entry away right now, that's a miss
+                if (!linked && !fs::copy_file(file.path(), target, fs::copy_options::overwrite_existing, error)) return false;
+                restored.push_back(target);
+            }
+            if (error || restored.empty()) return false;
+
+            // marks the entry as recently used
+            fs::last_write_time(entry, fs::file_time_type::clock::now(), error);
+            return true;
+        }
+        void BuildCache::Insert(const std::string& key, const std::vector<fs::path>& files)
+        {
+            const fs::path entry = entryPath(key);
+            if (files.empty() || fs::exists(entry)) return;
+
+            std::random_device random;
+            fs::path temporary = directory / (TemporaryPrefix + key + "-" + std::to_string(random()));
+            fs::create_directories(temporary);
+            for (const auto& file : files) fs::copy_file(file, temporary / file.filename(), fs::copy_options::overwrite_existing);
+
+            // fails if the entry appeared in the meantime, both hold the same files
+            std::error_code error;
+            fs::rename(temporary, entry, error);
+            if (error) fs::remove_all(temporary, error);
+        }
+        void BuildCache::Trim()
+        {
+            struct Entry {
+                fs::path path;
+                fs::file_time_type lastUse;
+                uintmax_t bytes = 0;
+            };
+            std::vector<Entry> entries;
+            uintmax_t total = 0;
+            std::error_code error;
+            const auto now = fs::file_time_type::clock::now();
+            for (const auto& folder : fs::directory_iterator(directory, error)) {
+                if (!folder.is_directory()) continue;
+                Entry entry{ folder.path(), fs::last_write_time(folder.path(), error) };
+                if (folder.path().filename().string().starts_with(TemporaryPrefix)) {
+                    if (!error && now - entry.lastUse > AbandonedAge) fs::remove_all(folder.path(), error);
+                    continue;
+                }
+                for (const auto& file : fs::directory_iterator(folder.path(), error)) {
+                    if (!file.is_regular_file(error)) continue;
+                    // a file another build removed in the meantime takes no space
+                    const uintmax_t bytes = file.file_size(error);
+                    if (!error) entry.bytes += bytes;
+                }
+                total += entry.bytes;
+                entries.push_back(entry);
+            }
+
+            std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+            for (const auto& entry : entries) {
+                if (total <= maxBytes) break;
+                fs::remove_all(entry.path, error);
+                total -= entry.bytes;
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * Directory of finished builds, one folder per key holding the files of that build
+        * entries are written to a temporary folder and renamed into place, so readers never see half an entry
+        * and several machines can share the same directory
+        * the modified time of an entry folder is its last use, the oldest ones go first when trimming
+        */
+        class BuildCache
+        {
+        private:
+            std::filesystem::path directory;
+            uintmax_t maxBytes;
+
+            std::filesystem::path entryPath(const std::string& key) const;
+        public:
+            BuildCache(std::filesystem::path directory, uintmax_t maxBytes);
+
+            /*
+            * copies the files of the entry into outputDir. hardLinks links them instead when the
+            * filesystem allows it, falling back to a copy. returns false if there's no such entry
+            */
+            bool Restore(const std::string& key, const std::filesystem::path& outputDir, bool hardLinks, std::vector<std::filesystem::path>& restored);
+            // stores the files as the entry of key. keeps the existing entry if another build got there first
+            void Insert(const std::string& key, const std::vector<std::filesystem::path>& files);
+            // removes the least recently used entries until the cache fits in its size
+            void Trim();
+
+            // hex string of a 128 bit hash of the text
+            static std::string MakeKey(const std::string& text);
+        };
+    }
+}
@@ -0,0 +1,199 @@
+#include "BuildStats.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include "../include/json.hpp" // For saving the stats
+
+#if defined(_WIN32) || defined(_WIN64)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+namespace QLE {
+    namespace TextureTools {
+#if defined(_WIN32) || defined(_WIN64)
+        static int64_t fileTimeNanoseconds(const FILETIME& kernel, const FILETIME& user)
+        {
+            auto ticks = [](const FILETIME& time) { return ((int64_t)time.dwHighDateTime << 32) | time.dwLowDateTime; };
+            // 100 ns ticks
+            return (ticks(kernel) + ticks(user)) * 100;
+        }
+#endif
+        int64_t BuildStats::ThreadCpuNanoseconds()
+        {
+#if defined(_WIN32) || defined(_WIN64)
+            FILETIME creation, exit, kernel, user;
+            if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0;
+            return fileTimeNanoseconds(kernel, user);
+#else
+            timespec time;
+            if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) return 0;
+            return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+#endif
+        }
+        int64_t BuildStats::ProcessCpuNanoseconds()
+        {
+#if defined(_WIN32) || defined(_WIN64)
+            FILETIME creation, exit, kernel, user;
+            if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0;
+            return fileTimeNanoseconds(kernel, user);
+#else
+            timespec time;
+            if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) return 0;
+            return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+#endif
+        }
+        const char* BuildStats::StageName(Stage stage)
+        {
+            switch (stage) {
+            case Stage::Scan: return "scan";
+            case Stage::Decode: return "decode";
+            case Stage::Plan: return "plan";
+            case Stage::Compose: return "compose";
+            case Stage::Quantize: return "quantize";
+            case Stage::Encode: return "encode";
+            case Stage::Write: return "write";
+            case Stage::Pngquant: return "pngquant";
+            case Stage::Json: return "json";
+            case Stage::Binary: return "bin";
+            case Stage::Pivot: return "pivot";
+            default: return "unknown";
+            }
+        }
+
+        BuildStats::Scope::Scope(BuildStats* stats, Stage stage, int sheet) : stats(stats), stage(stage), sheet(sheet)
+        {
+            if (!stats) return;
+            start = std::chrono::steady_clock::now();
+            cpuStart = ThreadCpuNanoseconds();
+        }
+        BuildStats::Scope::~Scope()
+        {
+            if (!stats) return;
+            int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            stats->add(stage, sheet, nanoseconds, ThreadCpuNanoseconds() - cpuStart, bytesIn, bytesOut, items);
+        }
+
+        BuildStats::BuildStats(std::string group) : group(std::move(group))
+        {
+            start = finish = std::chrono::steady_clock::now();
+            cpuStart = cpuFinish = ProcessCpuNanoseconds();
+        }
+        void BuildStats::add(Stage stage, int sheet, int64_t nanoseconds, int64_t cpuNanoseconds, int64_t bytesIn, int64_t bytesOut, int64_t items)
+        {
+            Totals& totals = stages[(int)stage];
+            totals.calls++;
+            totals.nanoseconds += nanoseconds;
+            totals.cpuNanoseconds += cpuNanoseconds;
+            totals.bytesIn += bytesIn;
+            totals.bytesOut += bytesOut;
+            totals.items += items;
+            if (sheet < 0) return;
+            std::lock_guard<std::mutex> lock(sheetsMutex);
+            Sheet& entry = sheets[sheet];
+            entry.nanoseconds[(int)stage] += nanoseconds;
+            entry.bytesOut += bytesOut;
+        }
+        void BuildStats::AddSheet(int index, int width, int height, int images)
+        {
+            std::lock_guard<std::mutex> lock(sheetsMutex);
+            Sheet& entry = sheets[index];
+            entry.width = width;
+            entry.height = height;
+            entry.images = images;
+        }
+        void BuildStats::Finish(int64_t imageCount)
+        {
+            finish = std::chrono::steady_clock::now();
+            cpuFinish = ProcessCpuNanoseconds();
+            images = imageCount;
+        }
+
+        static double milliseconds(int64_t nanoseconds) { return nanoseconds / 1e6; }
+        static double megabytes(int64_t bytes) { return bytes / (1024.0 * 1024.0); }
+        // amount per second, 0 for stages too short to measure
+        static double perSecond(double amount, int64_t nanoseconds) { return nanoseconds > 0 ? amount * 1e9 / nanoseconds : 0; }
+
+        void BuildStats::Print(std::ostream& out) const
+        {
+            const int64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+            std::ios state(nullptr);
+            state.copyfmt(out);
+            out << std::fixed << std::setprecision(1);
+            out << "[Info] Build stats of \"" << group << "\"" << std::endl;
+            out << "  " << std::left << std::setw(10) << "stage" << std::right
+                << std::setw(8) << "calls" << std::setw(12) << "time ms" << std::setw(12) << "cpu ms"
+                << std::setw(10) << "in MB" << std::setw(10) << "out MB" << std::setw(12) << "items/s" << std::setw(10) << "MB/s" << std::endl;
+            for (int s = 0; s < (int)Stage::Count; s++) {
+                const Totals& totals = stages[s];
+                if (totals.calls == 0) continue;
+                int64_t bytes = std::max(totals.bytesIn.load(), totals.bytesOut.load());
+                out << "  " << std::left << std::setw(10) << StageName((Stage)s) << std::right
+                    << std::setw(8) << totals.calls << std::setw(12) << milliseconds(totals.nanoseconds) << std::setw(12) << milliseconds(totals.cpuNanoseconds)
+                    << std::setw(10) << megabytes(totals.bytesIn) << std::setw(10) << megabytes(totals.bytesOut)
+                    << std::setw(12) << perSecond((double)totals.items, totals.nanoseconds) << std::setw(10) << perSecond(megabytes(bytes), totals.nanoseconds) << std::endl;
+            }
+            out << "  " << std::left << std::setw(10) << "total" << std::right << std::setw(8) << "" << std::setw(12) << milliseconds(wall)
+                << std::setw(12) << milliseconds(cpuFinish - cpuStart) << std::setw(10) << megabytes(stages[(int)Stage::Decode].bytesIn)
+                << std::setw(10) << megabytes(stages[(int)Stage::Write].bytesOut + stages[(int)Stage::Json].bytesOut + stages[(int)Stage::Binary].bytesOut)
+                << std::setw(12) << perSecond((double)images, wall) << std::setw(10) << perSecond(megabytes(stages[(int)Stage::Decode].bytesIn), wall) << std::endl;
+
+            std::lock_guard<std::mutex> lock(sheetsMutex);
+            if (!sheets.empty()) {
+                out << "  " << std::left << std::setw(10) << "sheet" << std::right << std::setw(12) << "size" << std::setw(8) << "images";
+                for (Stage stage : { Stage::Decode, Stage::Compose, Stage::Quantize, Stage::Encode, Stage::Write, Stage::Json })
+                    out << std::setw(11) << StageName(stage) << " ms";
+                out << std::setw(10) << "out MB" << std::endl;
+                for (const auto& [index, sheet] : sheets) {
+                    out << "  " << std::left << std::setw(10) << index << std::right
+                        << std::setw(12) << (std::to_string(sheet.width) + "x" + std::to_string(sheet.height)) << std::setw(8) << sheet.images;
+                    for (Stage stage : { Stage::Decode, Stage::Compose, Stage::Quantize, Stage::Encode, Stage::Write, Stage::Json })
+                        out << std::setw(14) << milliseconds(sheet.nanoseconds[(int)stage]);
+                    out << std::setw(10) << megabytes(sheet.bytesOut) << std::endl;
+                }
+            }
+            out.copyfmt(state);
+        }
+        void BuildStats::Save(const std::filesystem::path& path) const
+        {
+            const int64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+            nlohmann::json json;
+            json["group"] = group;
+            json["images"] = images;
+            json["wallMs"] = milliseconds(wall);
+            json["cpuMs"] = milliseconds(cpuFinish - cpuStart);
+            json["imagesPerSecond"] = perSecond((double)images, wall);
+            nlohmann::json& stageList = json["stages"];
+            stageList = nlohmann::json::object();
+            for (int s = 0; s < (int)Stage::Count; s++) {
+                const Totals& totals = stages[s];
+                if (totals.calls == 0) continue;
+                stageList[StageName((Stage)s)] = {
+                    {"calls", totals.calls.load()},
+                    {"timeMs", milliseconds(totals.nanoseconds)},
+                    {"cpuMs", milliseconds(totals.cpuNanoseconds)},
+                    {"bytesIn", totals.bytesIn.load()},
+                    {"bytesOut", totals.bytesOut.load()},
+                    {"items", totals.items.load()}
+                };
+            }
+            nlohmann::json& sheetList = json["sheets"];
+            sheetList = nlohmann::json::array();
+            std::lock_guard<std::mutex> lock(sheetsMutex);
+            for (const auto& [index, sheet] : sheets) {
+                nlohmann::json entry = { {"index", index}, {"width", sheet.width}, {"height", sheet.height}, {"images", sheet.images}, {"bytesOut", sheet.bytesOut} };
+                for (int s = 0; s < (int)Stage::Count; s++)
+                    if (sheet.nanoseconds[s] > 0) entry["timeMs"][StageName((Stage)s)] = milliseconds(sheet.nanoseconds[s]);
+                sheetList.push_back(entry);
+            }
+
+            std::ofstream file(path);
+            if (!file.is_open()) throw std::runtime_error("Failed to write the stats to " + path.string());
+            file << json.dump(4);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace QLE {
+    namespace TextureTools {
+        // Parts of a build that are timed separately
+        enum class Stage {
+            Scan,
+            Decode,
+            Plan,
+            Compose,
+            Quantize,
+            Encode,
+            Write,
+            Pngquant,
+            Json,
+            Binary,
+            Pivot,
+            Count
+        };
+        /*
+        * Time, CPU time and bytes spent in every stage of a build, in total and per sheet
+        * stages running on several threads add up the time of every thread, so a stage can take longer than the build
+        * the CPU time is the one of the thread running the scope. pool threads helping it aren't counted
+        * safe to use from several threads
+        */
+        class BuildStats
+        {
+        public:
+            // times a part of a stage from construction to destruction. does nothing without stats
+            class Scope
+            {
+            private:
+                BuildStats* stats;
+                Stage stage;
+                int sheet;
+                std::chrono::steady_clock::time_point start;
+                int64_t cpuStart = 0;
+                int64_t bytesIn = 0, bytesOut = 0, items = 0;
+            public:
+                // sheet -1 for the stages that aren't about a single sheet
+                Scope(BuildStats* stats, Stage stage, int sheet = -1);
+                ~Scope();
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+                // bytes read and written by this part of the stage
+                void Bytes(int64_t in, int64_t out) { bytesIn += in; bytesOut += out; }
+                // images, sheets or files handled
+                void Items(int64_t count) { items += count; }
+            };
+        private:
+            struct Totals {
+                std::atomic<int64_t> calls = 0, nanoseconds = 0, cpuNanoseconds = 0;
+                std::atomic<int64_t> bytesIn = 0, bytesOut = 0, items = 0;
+            };
+            struct Sheet {
+                int width = 0, height = 0, images = 0;
+                int64_t nanoseconds[(int)Stage::Count] = {};
+                int64_t bytesOut = 0;
+            };
+            std::string group;
+            Totals stages[(int)Stage::Count];
+            std::map<int, Sheet> sheets;
+            mutable std::mutex sheetsMutex;
+            std::chrono::steady_clock::time_point start, finish;
+            int64_t cpuStart = 0, cpuFinish = 0;
+            int64_t images = 0;
+
+            void add(Stage stage, int sheet, int64_t nanoseconds, int64_t cpuNanoseconds, int64_t bytesIn, int64_t bytesOut, int64_t items);
+        public:
+            // starts the build clock
+            explicit BuildStats(std::string group);
+
+            void AddSheet(int index, int width, int height, int images);
+            // stops the build clock
+            void Finish(int64_t imageCount);
+
+            // table of every stage followed by one line per sheet
+            void Print(std::ostream& out) const;
+            // same numbers as a .json for tools comparing builds
+            void Save(const std::filesystem::path& path) const;
+
+            static const char* StageName(Stage stage);
+            // CPU time of the calling thread / of the whole process
+            static int64_t ThreadCpuNanoseconds();
+            static int64_t ProcessCpuNanoseconds();
+        };
+    }
+}
@@ -0,0 +1,141 @@
+#include "DirectoryWatcher.h"
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+#define TP_WATCH_INOTIFY
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace QLE {
+    namespace TextureTools {
+#if defined(TP_WATCH_INOTIFY)
+        // everything that ends with a file having other content, or a folder appearing
+        static const uint32_t WatchedEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF;
+#endif
+
+        DirectoryWatcher::DirectoryWatcher(fs::path directory, bool recursive, std::function<bool(const fs::path&)> filter)
+            : directory(std::move(directory)), recursive(recursive), filter(std::move(filter))
+        {
+#if defined(TP_WATCH_INOTIFY)
+            notifyHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (notifyHandle >= 0) addWatches(this->directory);
+            if (notifyHandle >= 0 && watches.empty()) {
+                close(notifyHandle);
+                notifyHandle = -1;
+            }
+#endif
+            if (notifyHandle < 0) snapshot = takeSnapshot();
+        }
+        DirectoryWatcher::~DirectoryWatcher()
+        {
+#if defined(TP_WATCH_INOTIFY)
+            if (notifyHandle >= 0) close(notifyHandle);
+#endif
+        }
+
+        void DirectoryWatcher::addWatches(const fs::path& folder)
+        {
+#if defined(TP_WATCH_INOTIFY)
+            int watch = inotify_add_watch(notifyHandle, folder.string().c_str(), WatchedEvents);
+            if (watch >= 0) watches[watch] = folder;
+            if (!recursive) return;
+            std::error_code error;
+            for (const auto& entry : fs::directory_iterator(folder, error))
+                if (entry.is_directory(error) && !entry.is_symlink(error)) addWatches(entry.path());
+#else
+            (void)folder;
+#endif
+        }
+        bool DirectoryWatcher::readEvents()
+        {
+            bool relevant = false;
+#if defined(TP_WATCH_INOTIFY)
+            alignas(inotify_event) char buffer[16 * 1024];
+            while (true) {
+                ssize_t length = read(notifyHandle, buffer, sizeof(buffer));
+                if (length <= 0) break;
+                for (char* cursor = buffer; cursor < buffer + length;) {
+                    const inotify_event* event = (const inotify_event*)cursor;
+                    cursor += sizeof(inotify_event) + event->len;
+                    // events were dropped, something changed
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        relevant = true;
+                        continue;
+                    }
+                    auto folder = watches.find(event->wd);
+                    if (folder == watches.end()) continue;
+                    if (event->mask & IN_IGNORED) {
+                        watches.erase(folder);
+                        continue;
+                    }
+                    if (event->len == 0) continue;
+                    fs::path path = folder->second / event->name;
+                    if (event->mask & IN_ISDIR) {
+                        // a new folder may have been moved in with images already inside
+                        if (recursive && (event->mask & (IN_CREATE | IN_MOVED_TO))) addWatches(path);
+                        relevant |= recursive;
+                        continue;
+                    }
+                    // a new file isn't complete before it's closed
+                    if (event->mask & IN_CREATE) continue;
+                    relevant |= filter(path);
+                }
+            }
+#endif
+            return relevant;
+        }
+        bool DirectoryWatcher::waitForEvents(int timeoutMs)
+        {
+#if defined(TP_WATCH_INOTIFY)
+            pollfd handle{ notifyHandle, POLLIN, 0 };
+            return poll(&handle, 1, timeoutMs) > 0;
+#else
+            (void)timeoutMs;
+            return false;
+#endif
+        }
+
+        std::map<std::string, FileStamp> DirectoryWatcher::takeSnapshot() const
+        {
+            std::map<std::string, FileStamp> files;
+            std::error_code error;
+            auto add = [&](const fs::directory_entry& entry) {
+                if (!entry.is_regular_file(error) || !filter(entry.path())) return;
+                // a file can vanish between listing and reading it
+                try { files[entry.path().string()] = FileStamp::Read(entry.path()); }
+                catch (const fs::filesystem_error&) {}
+            };
+            if (recursive) for (const auto& entry : fs::recursive_directory_iterator(directory, error)) add(entry);
+            else for (const auto& entry : fs::directory_iterator(directory, error)) add(entry);
+            return files;
+        }
+
+        void DirectoryWatcher::WaitForChanges(std::chrono::milliseconds debounce)
+        {
+            if (UsesNotifications()) {
+                while (!(waitForEvents(-1) && readEvents()));
+                // keep reading until the burst is over
+                while (waitForEvents((int)debounce.count())) readEvents();
+                return;
+            }
+
+            std::map<std::string, FileStamp> current;
+            do {
+                std::this_thread::sleep_for(std::chrono::milliseconds(PollIntervalMs));
+                current = takeSnapshot();
+            } while (current == snapshot);
+            while (true) {
+                std::this_thread::sleep_for(debounce);
+                std::map<std::string, FileStamp> next = takeSnapshot();
+                if (next == current) break;
+                current = std::move(next);
+            }
+            snapshot = std::move(current);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include "Manifest.h"
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * Waits for files to change under a directory
+        * uses inotify on Linux and falls back to comparing the size and modified time of every file
+        * a few times per second everywhere else
+        */
+        class DirectoryWatcher
+        {
+        private:
+            std::filesystem::path directory;
+            bool recursive;
+            // true for the files worth waking up for
+            std::function<bool(const std::filesystem::path&)> filter;
+
+            int notifyHandle = -1;
+            // watch descriptor -> folder
+            std::unordered_map<int, std::filesystem::path> watches;
+            void addWatches(const std::filesystem::path& folder);
+            // reads the pending events. true if any of them passes the filter
+            bool readEvents();
+            // waits up to timeout for events. true if there were some
+            bool waitForEvents(int timeoutMs);
+
+            std::map<std::string, FileStamp> snapshot;
+            std::map<std::string, FileStamp> takeSnapshot() const;
+        public:
+            static constexpr int PollIntervalMs = 250;
+
+            DirectoryWatcher(std::filesystem::path directory, bool recursive, std::function<bool(const std::filesystem::path&)> filter);
+            ~DirectoryWatcher();
+            DirectoryWatcher(const DirectoryWatcher&) = delete;
+            DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+            // blocks until a file changed, then until nothing else changed for the debounce time
+            void WaitForChanges(std::chrono::milliseconds debounce);
+            // false when polling
+            bool UsesNotifications() const { return notifyHandle >= 0; }
+        };
+    }
+}
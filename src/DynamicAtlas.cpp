@@ -0,0 +1,192 @@
+#include "DynamicAtlas.h"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <string>
+#include "Blit.h"
+
+namespace QLE {
+    namespace TextureTools {
+        // shelves are rounded up so sprites of about the same height share them
+        static int shelfHeightFor(int h) {
+            return (h + DynamicAtlas::ShelfGranularity - 1) / DynamicAtlas::ShelfGranularity * DynamicAtlas::ShelfGranularity;
+        }
+
+        DynamicAtlas::DynamicAtlas(int width, int height) : width(width), height(height)
+        {
+            if (width <= 0 || height <= 0) throw std::runtime_error("Invalid atlas size: " + std::to_string(width) + "x" + std::to_string(height));
+            pixels.assign((size_t)width * height * Blit::BytesPerPixel, 0);
+            addBand(0, height);
+        }
+
+        void DynamicAtlas::addSpan(int y, int x, int spanWidth) {
+            Shelf& shelf = shelves[y];
+            // joins the free spans next to it
+            auto next = shelf.free.lower_bound(x);
+            if (next != shelf.free.begin()) {
+                auto previous = std::prev(next);
+                if (previous->first + previous->second == x) {
+                    x = previous->first;
+                    spanWidth += previous->second;
+                    removeSpan(shelf, y, previous);
+                }
+            }
+            if (next != shelf.free.end() && next->first == x + spanWidth) {
+                spanWidth += next->second;
+                removeSpan(shelf, y, next);
+            }
+            shelf.free[x] = spanWidth;
+            spans.insert({ shelf.height, spanWidth, y, x });
+        }
+        void DynamicAtlas::removeSpan(Shelf& shelf, int y, std::map<int, int>::iterator span) {
+            spans.erase({ shelf.height, span->second, y, span->first });
+            shelf.free.erase(span);
+        }
+        void DynamicAtlas::addBand(int y, int bandHeight) {
+            auto next = bands.lower_bound(y);
+            if (next != bands.begin()) {
+                auto previous = std::prev(next);
+                if (previous->first + previous->second == y) {
+                    y = previous->first;
+                    bandHeight += previous->second;
+                    removeBand(previous);
+                }
+            }
+            if (next != bands.end() && next->first == y + bandHeight) {
+                bandHeight += next->second;
+                removeBand(next);
+            }
+            bands[y] = bandHeight;
+            bandsBySize.insert({ bandHeight, y });
+        }
+        void DynamicAtlas::removeBand(std::map<int, int>::iterator band) {
+            bandsBySize.erase({ band->second, band->first });
+            bands.erase(band);
+        }
+        void DynamicAtlas::setUsedWidth(int y, Shelf& shelf, int usedWidth) {
+            if (shelf.usedWidth > 0) shelvesByUse.erase({ shelf.usedWidth, y });
+            shelf.usedWidth = usedWidth;
+            if (usedWidth > 0) shelvesByUse.insert({ usedWidth, y });
+        }
+
+        bool DynamicAtlas::allocate(int w, int h, int skippedShelf, int newShelfLimit, int& x, int& y) {
+            const int needed = shelfHeightFor(h);
+            // a shelf up to half again as tall is fine, anything taller wastes too much of it
+            const int tallest = std::max(needed, shelfHeightFor(h + h / 2));
+            for (int shelfHeight = needed; shelfHeight <= tallest; shelfHeight += ShelfGranularity) {
+                // the narrowest span that is wide enough
+                for (auto span = spans.lower_bound({ shelfHeight, w, INT_MIN, INT_MIN }); span != spans.end() && span->height == shelfHeight; ++span) {
+                    if (span->y == skippedShelf) continue;
+                    x = span->x;
+                    y = span->y;
+                    Shelf& shelf = shelves[y];
+                    const int spanWidth = span->width;
+                    removeSpan(shelf, y, shelf.free.find(x));
+                    if (spanWidth > w) addSpan(y, x + w, spanWidth - w);
+                    setUsedWidth(y, shelf, shelf.usedWidth + w);
+                    return true;
+                }
+            }
+            // a new shelf in the shortest band that holds it
+            if (needed > newShelfLimit) return false;
+            auto fit = bandsBySize.lower_bound({ needed, INT_MIN });
+            // the last rows of a sheet that isn't a multiple of ShelfGranularity tall
+            if (fit == bandsBySize.end()) fit = bandsBySize.lower_bound({ h, INT_MIN });
+            if (fit == bandsBySize.end()) return false;
+            const int bandY = fit->second, bandHeight = fit->first;
+            const int shelfHeight = std::min(needed, bandHeight);
+            removeBand(bands.find(bandY));
+            if (bandHeight > shelfHeight) addBand(bandY + shelfHeight, bandHeight - shelfHeight);
+
+            Shelf& shelf = shelves[bandY];
+            shelf.height = shelfHeight;
+            x = 0;
+            y = bandY;
+            if (width > w) addSpan(y, w, width - w);
+            setUsedWidth(y, shelf, w);
+            return true;
+        }
+        void DynamicAtlas::release(const SpriteRect& rect) {
+            auto found = shelves.find(rect.y);
+            Shelf& shelf = found->second;
+            addSpan(rect.y, rect.x, rect.w);
+            setUsedWidth(rect.y, shelf, shelf.usedWidth - rect.w);
+            if (shelf.usedWidth > 0) return;
+            // an empty shelf goes back to the free bands, so its height can be used by sprites of any size
+            removeSpan(shelf, rect.y, shelf.free.begin());
+            const int shelfHeight = shelf.height;
+            shelves.erase(found);
+            addBand(rect.y, shelfHeight);
+        }
+
+        bool DynamicAtlas::Insert(int id, const uint8_t* source, int w, int h) {
+            if (sprites.count(id)) throw std::runtime_error("Sprite " + std::to_string(id) + " is already in the atlas");
+            if (w <= 0 || h <= 0 || w > width || h > height) return false;
+            SpriteRect rect;
+            rect.id = id;
+            rect.w = w;
+            rect.h = h;
+            if (!allocate(w, h, -1, INT_MAX, rect.x, rect.y)) return false;
+            shelves[rect.y].ids.insert(id);
+            sprites[id] = rect;
+            usedArea += (int64_t)w * h;
+            if (source) {
+                Blit::CopyRect(pixels.data(), width, rect.x, rect.y, source, w, 0, 0, w, h);
+                dirty.push_back(rect);
+            }
+            return true;
+        }
+        bool DynamicAtlas::Remove(int id) {
+            auto found = sprites.find(id);
+            if (found == sprites.end()) return false;
+            const SpriteRect rect = found->second;
+            sprites.erase(found);
+            shelves[rect.y].ids.erase(id);
+            usedArea -= (int64_t)rect.w * rect.h;
+            release(rect);
+            return true;
+        }
+        const SpriteRect* DynamicAtlas::Find(int id) const {
+            auto found = sprites.find(id);
+            return found != sprites.end() ? &found->second : nullptr;
+        }
+
+        std::vector<DynamicAtlas::Move> DynamicAtlas::Defragment() {
+            std::vector<Move> moves;
+            if (shelves.size() < 2) return moves;
+            const int source = shelvesByUse.begin()->second;
+            const Shelf& shelf = shelves[source];
+            const std::vector<int> ids(shelf.ids.begin(), shelf.ids.end());
+            // moving into a new shelf as tall as this one would gain nothing
+            const int newShelfLimit = shelf.height - ShelfGranularity;
+
+            // every sprite gets a spot before any of them moves, so a shelf that can't be emptied stays as it was
+            for (int id : ids) {
+                Move move;
+                move.id = id;
+                move.from = move.to = sprites[id];
+                if (!allocate(move.from.w, move.from.h, source, newShelfLimit, move.to.x, move.to.y)) {
+                    for (const auto& planned : moves) release(planned.to);
+                    return {};
+                }
+                moves.push_back(move);
+            }
+            for (const auto& move : moves) {
+                // the new spot is free space, so it never overlaps the old one
+                Blit::CopyRect(pixels.data(), width, move.to.x, move.to.y, pixels.data(), width, move.from.x, move.from.y, move.from.w, move.from.h);
+                dirty.push_back(move.to);
+                sprites[move.id] = move.to;
+                shelves[move.to.y].ids.insert(move.id);
+                shelves[source].ids.erase(move.id);
+                // the last one takes the shelf with it
+                release(move.from);
+            }
+            return moves;
+        }
+        std::vector<SpriteRect> DynamicAtlas::TakeDirtyRegions() {
+            std::vector<SpriteRect> regions;
+            regions.swap(dirty);
+            return regions;
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "RectPacker.h"
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * A single RGBA sheet that sprites are added to and removed from while it's in use, like a glyph cache
+        * the sheet is cut into shelves as tall as the sprites they hold, rounded up to ShelfGranularity
+        * free spans of the shelves and free bands between them are kept sorted, so insert and remove are O(log n)
+        * only the rects that were written are reported as dirty, the sheet is never composed again as a whole
+        * not safe to use from several threads
+        */
+        class DynamicAtlas
+        {
+        public:
+            static constexpr int ShelfGranularity = 8;
+            // a sprite moved by Defragment
+            struct Move {
+                int id;
+                SpriteRect from, to;
+            };
+        private:
+            struct Shelf {
+                int height = 0;
+                // free spans by x, and their width
+                std::map<int, int> free;
+                int usedWidth = 0;
+                // sprites in the shelf
+                std::set<int> ids;
+            };
+            // a free span, sorted by shelf height first for best fit
+            struct Span {
+                int height, width, y, x;
+                bool operator<(const Span& other) const {
+                    if (height != other.height) return height < other.height;
+                    if (width != other.width) return width < other.width;
+                    if (y != other.y) return y < other.y;
+                    return x < other.x;
+                }
+            };
+            int width, height;
+            std::vector<uint8_t> pixels;
+            // shelves by y
+            std::map<int, Shelf> shelves;
+            std::set<Span> spans;
+            // space no shelf uses, by y and by (height, y)
+            std::map<int, int> bands;
+            std::set<std::pair<int, int>> bandsBySize;
+            // shelves by (used width, y), the emptiest is evacuated first
+            std::set<std::pair<int, int>> shelvesByUse;
+            std::unordered_map<int, SpriteRect> sprites;
+            std::vector<SpriteRect> dirty;
+            int64_t usedArea = 0;
+
+            void addSpan(int y, int x, int spanWidth);
+            void removeSpan(Shelf& shelf, int y, std::map<int, int>::iterator span);
+            void addBand(int y, int bandHeight);
+            void removeBand(std::map<int, int>::iterator band);
+            void setUsedWidth(int y, Shelf& shelf, int usedWidth);
+            /*
+            * takes room for a w x h rect outside the shelf at skippedShelf
+            * new shelves are only opened up to newShelfLimit tall. returns false if there is no room
+            */
+            bool allocate(int w, int h, int skippedShelf, int newShelfLimit, int& x, int& y);
+            // gives the room of the rect back, and the shelf once it's empty
+            void release(const SpriteRect& rect);
+        public:
+            DynamicAtlas(int width, int height);
+
+            int Width() const { return width; }
+            int Height() const { return height; }
+            // RGBA, Width() * Height() * 4 bytes
+            const std::vector<uint8_t>& Pixels() const { return pixels; }
+            /*
+            * copies the RGBA pixels of the sprite into a free spot and marks it dirty
+            * pixels can be null to only reserve the spot
+            * returns false if the sprite doesn't fit anywhere. throws std::runtime_error if id is already in the atlas
+            */
+            bool Insert(int id, const uint8_t* pixels, int width, int height);
+            // frees the spot of the sprite. its pixels stay until something else is placed there. returns false if id isn't in the atlas
+            bool Remove(int id);
+            // the spot of the sprite, null if id isn't in the atlas
+            const SpriteRect* Find(int id) const;
+            /*
+            * moves the sprites out of the emptiest shelf into the others so its height can be used again
+            * costs O(log n) per sprite moved. the pixels are moved as well and the new spots are marked dirty
+            * returns the sprites that moved, none if the shelf couldn't be emptied
+            */
+            std::vector<Move> Defragment();
+            // the rects written since the last call, to upload only those
+            std::vector<SpriteRect> TakeDirtyRegions();
+
+            size_t Count() const { return sprites.size(); }
+            // area of the sprites against the area of the sheet
+            double FillRatio() const { return (double)usedArea / ((double)width * height); }
+        };
+    }
+}
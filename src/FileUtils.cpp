@@ -0,0 +1,21 @@
+#include "FileUtils.h"
+#include <fstream>
+
+namespace QLE {
+    namespace TextureTools {
+        bool SaveFileAtomically(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+        {
+            std::filesystem::path temporary = path;
+            temporary += ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::binary);
+                if (!file.is_open()) return false;
+                file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+                if (!file.good()) return false;
+            }
+            std::error_code error;
+            std::filesystem::rename(temporary, path, error);
+            return !error;
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * writes the bytes to a temporary file next to path and renames it over path
+        * the old file is replaced instead of overwritten, so hard links to it, like the ones
+        * pointing into the build cache, keep their content. returns false if the file can't be written
+        */
+        bool SaveFileAtomically(const std::filesystem::path& path, const std::vector<uint8_t>& bytes);
+    }
+}
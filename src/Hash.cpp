@@ -0,0 +1,79 @@
+#include "Hash.h"
+#include <cstring>
+
+namespace QLE {
+    namespace TextureTools {
+        namespace {
+            const uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+            const uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+            const uint64_t Prime3 = 0x165667B19E3779F9ull;
+            const uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+            const uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+            inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+            inline uint64_t read64(const uint8_t* p) { uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+            inline uint32_t read32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+            inline uint64_t round(uint64_t acc, uint64_t input) {
+                acc += input * Prime2;
+                acc = rotl(acc, 31);
+                return acc * Prime1;
+            }
+            inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+                acc ^= round(0, value);
+                return acc * Prime1 + Prime4;
+            }
+        }
+
+        uint64_t Hash64(const void* data, size_t length, uint64_t seed)
+        {
+            const uint8_t* p = (const uint8_t*)data;
+            const uint8_t* end = p + length;
+            uint64_t hash;
+
+            if (length >= 32) {
+                // four independent lanes so the multiplies can overlap
+                uint64_t v1 = seed + Prime1 + Prime2;
+                uint64_t v2 = seed + Prime2;
+                uint64_t v3 = seed;
+                uint64_t v4 = seed - Prime1;
+                const uint8_t* limit = end - 32;
+                do {
+                    v1 = round(v1, read64(p));
+                    v2 = round(v2, read64(p + 8));
+                    v3 = round(v3, read64(p + 16));
+                    v4 = round(v4, read64(p + 24));
+                    p += 32;
+                } while (p <= limit);
+                hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+                hash = mergeRound(hash, v1);
+                hash = mergeRound(hash, v2);
+                hash = mergeRound(hash, v3);
+                hash = mergeRound(hash, v4);
+            }
+            else hash = seed + Prime5;
+
+            hash += (uint64_t)length;
+            for (; p + 8 <= end; p += 8) {
+                hash ^= round(0, read64(p));
+                hash = rotl(hash, 27) * Prime1 + Prime4;
+            }
+            if (p + 4 <= end) {
+                hash ^= (uint64_t)read32(p) * Prime1;
+                hash = rotl(hash, 23) * Prime2 + Prime3;
+                p += 4;
+            }
+            for (; p < end; p++) {
+                hash ^= (*p) * Prime5;
+                hash = rotl(hash, 11) * Prime1;
+            }
+
+            // avalanche
+            hash ^= hash >> 33;
+            hash *= Prime2;
+            hash ^= hash >> 29;
+            hash *= Prime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace QLE {
+    namespace TextureTools {
+        // xxHash64. fast non-cryptographic hash used to find identical content
+        uint64_t Hash64(const void* data, size_t length, uint64_t seed = 0);
+    }
+}
@@ -0,0 +1,55 @@
+#include "ImageCache.h"
+
+namespace QLE {
+    namespace TextureTools {
+        void ImageCache::erase(std::unordered_map<std::string, Entry>::iterator entry)
+        {
+            bytes -= entry->second.image->pixels.size();
+            recentlyUsed.erase(entry->second.use);
+            entries.erase(entry);
+        }
+        std::shared_ptr<const DecodedImage> ImageCache::Find(const std::string& path, const FileStamp& stamp)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = entries.find(path);
+            if (found == entries.end() || !(found->second.stamp == stamp)) return nullptr;
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.use);
+            return found->second.image;
+        }
+        void ImageCache::Store(const std::string& path, const FileStamp& stamp, std::shared_ptr<const DecodedImage> image)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = entries.find(path);
+            if (found != entries.end()) erase(found);
+            bytes += image->pixels.size();
+            recentlyUsed.push_front(path);
+            entries[path] = { stamp, std::move(image), recentlyUsed.begin() };
+            // the image just stored stays, even if it's bigger than the whole cache
+            while (maxBytes > 0 && bytes > maxBytes && recentlyUsed.size() > 1)
+                erase(entries.find(recentlyUsed.back()));
+        }
+        void ImageCache::Retain(const std::unordered_set<std::string>& paths)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto entry = entries.begin(); entry != entries.end();) {
+                if (paths.count(entry->first)) {
+                    ++entry;
+                    continue;
+                }
+                auto next = std::next(entry);
+                erase(entry);
+                entry = next;
+            }
+        }
+        size_t ImageCache::Count() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return entries.size();
+        }
+        size_t ImageCache::Bytes() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return bytes;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Manifest.h"
+
+namespace QLE {
+    namespace TextureTools {
+        // RGBA pixels of an image as they were decoded
+        struct DecodedImage {
+            int width = 0, height = 0, channels = 0;
+            std::vector<uint8_t> pixels;
+        };
+        /*
+        * Decoded images kept in memory between builds, keyed by path
+        * an entry is only handed out while the file still has the size and modified time it was decoded with
+        * past maxBytes the least recently used images are forgotten. images still being packed stay alive until the build is done
+        * safe to use from several threads
+        */
+        class ImageCache
+        {
+        private:
+            struct Entry {
+                FileStamp stamp;
+                std::shared_ptr<const DecodedImage> image;
+                // position in recentlyUsed
+                std::list<std::string>::iterator use;
+            };
+            std::unordered_map<std::string, Entry> entries;
+            // most recently used first
+            std::list<std::string> recentlyUsed;
+            mutable std::mutex mutex;
+            size_t bytes = 0;
+            size_t maxBytes;
+
+            void erase(std::unordered_map<std::string, Entry>::iterator entry);
+        public:
+            // 0 keeps every image
+            explicit ImageCache(size_t maxBytes = 0) : maxBytes(maxBytes) {}
+
+            // null if the image isn't cached or the file changed since
+            std::shared_ptr<const DecodedImage> Find(const std::string& path, const FileStamp& stamp);
+            void Store(const std::string& path, const FileStamp& stamp, std::shared_ptr<const DecodedImage> image);
+            // forgets every image that isn't in paths
+            void Retain(const std::unordered_set<std::string>& paths);
+
+            size_t Count() const;
+            // size of all the cached pixels
+            size_t Bytes() const;
+        };
+    }
+}
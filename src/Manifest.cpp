@@ -0,0 +1,97 @@
+#include "Manifest.h"
+#include <fstream>
+#include <stdexcept>
+#include "../include/json.hpp"
+
+namespace fs = std::filesystem;
+
+namespace QLE {
+    namespace TextureTools {
+        FileStamp FileStamp::Read(const fs::path& path)
+        {
+            FileStamp stamp;
+            stamp.size = fs::file_size(path);
+            stamp.modifiedTime = (int64_t)fs::last_write_time(path).time_since_epoch().count();
+            return stamp;
+        }
+
+        bool Manifest::Load(const fs::path& path)
+        {
+            std::ifstream file(path);
+            if (!file.is_open()) return false;
+            try {
+                nlohmann::json json = nlohmann::json::parse(file);
+                if (json.value("version", 0) != Version) return false;
+
+                settings = json["settings"].get<std::string>();
+                sheets.clear();
+                for (const auto& sheet : json["sheets"]) {
+                    SheetLayout layout;
+                    layout.width = sheet["width"];
+                    layout.height = sheet["height"];
+                    sheets.push_back(layout);
+                }
+                images.clear();
+                for (const auto& entry : json["images"]) {
+                    ManifestImage image;
+                    image.path = entry["path"].get<std::string>();
+                    image.stamp.size = entry["fileSize"];
+                    image.stamp.modifiedTime = entry["modified"];
+                    image.hash = entry["hash"];
+                    image.sheet = entry["sheet"];
+                    image.rect.x = entry["rect"]["x"];
+                    image.rect.y = entry["rect"]["y"];
+                    image.rect.w = entry["rect"]["width"];
+                    image.rect.h = entry["rect"]["height"];
+                    image.sourceWidth = entry["sourceSize"]["width"];
+                    image.sourceHeight = entry["sourceSize"]["height"];
+                    image.offsetX = entry["offset"]["x"];
+                    image.offsetY = entry["offset"]["y"];
+                    image.alias = entry.value("alias", false);
+                    if (image.sheet < 0 || image.sheet >= (int)sheets.size()) return false;
+                    images.push_back(image);
+                }
+            }
+            catch (const nlohmann::json::exception&) {
+                return false;
+            }
+            return true;
+        }
+        void Manifest::Save(const fs::path& path) const
+        {
+            nlohmann::json json;
+            json["version"] = Version;
+            json["settings"] = settings;
+            json["sheets"] = nlohmann::json::array();
+            for (const auto& sheet : sheets)
+                json["sheets"].push_back({ {"width", sheet.width}, {"height", sheet.height} });
+            json["images"] = nlohmann::json::array();
+            for (const auto& image : images) {
+                nlohmann::json entry;
+                entry["path"] = image.path;
+                entry["fileSize"] = image.stamp.size;
+                entry["modified"] = image.stamp.modifiedTime;
+                entry["hash"] = image.hash;
+                entry["sheet"] = image.sheet;
+                entry["rect"] = { {"x", image.rect.x}, {"y", image.rect.y}, {"width", image.rect.w}, {"height", image.rect.h} };
+                entry["sourceSize"] = { {"width", image.sourceWidth}, {"height", image.sourceHeight} };
+                entry["offset"] = { {"x", image.offsetX}, {"y", image.offsetY} };
+                if (image.alias) entry["alias"] = true;
+                json["images"].push_back(entry);
+            }
+
+            fs::path temporary = path;
+            temporary += ".tmp";
+            {
+                std::ofstream file(temporary);
+                if (!file.is_open()) throw std::runtime_error("Failed to open manifest for writing: " + temporary.string());
+                file << json.dump(1);
+            }
+            fs::rename(temporary, path);
+        }
+        fs::path Manifest::PathFor(const fs::path& outputDir, const std::string& group)
+        {
+            return outputDir / (group + ".manifest");
+        }
+    }
+}
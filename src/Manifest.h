@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "RectPacker.h"
+
+namespace QLE {
+    namespace TextureTools {
+        // Size and last write time of a file. cheap to read, checked before hashing anything
+        struct FileStamp {
+            uintmax_t size = 0;
+            int64_t modifiedTime = 0;
+
+            static FileStamp Read(const std::filesystem::path& path);
+            inline bool operator==(const FileStamp& other) const { return size == other.size && modifiedTime == other.modifiedTime; }
+        };
+        struct ManifestImage {
+            std::string path;
+            FileStamp stamp;
+            // hash of the pixels that went into the sheet
+            uint64_t hash = 0;
+            int sheet = 0;
+            SpriteRect rect;
+            // same as ImageData
+            int sourceWidth = 0, sourceHeight = 0;
+            int offsetX = 0, offsetY = 0;
+            // a duplicate sharing the rect of the last image before it that isn't an alias
+            bool alias = false;
+        };
+        /*
+        * What the last build of a group produced and from which inputs
+        * images are listed sheet by sheet in the order they were written to the .json
+        */
+        struct Manifest {
+            static constexpr int Version = 1;
+
+            // settings that change the output. a build with other settings can't reuse anything
+            std::string settings;
+            // size of every sheet
+            std::vector<SheetLayout> sheets;
+            std::vector<ManifestImage> images;
+
+            // returns false if the file is missing, unreadable or from another version
+            bool Load(const std::filesystem::path& path);
+            // writes a temporary file first so a cancelled build never leaves half a manifest
+            void Save(const std::filesystem::path& path) const;
+
+            // the manifest of a group is kept next to its sheets
+            static std::filesystem::path PathFor(const std::filesystem::path& outputDir, const std::string& group);
+        };
+    }
+}
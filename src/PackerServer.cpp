@@ -0,0 +1,298 @@
+#include "PackerServer.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include "TexturePacker.h"
+#include "../include/json.hpp" // For the requests and replies
+
+#if defined(_WIN32) || defined(_WIN64)
+#define TP_SERVER_UNSUPPORTED
+#else
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace fs = std::filesystem;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+namespace QLE {
+    namespace TextureTools {
+        // a request is a short list of options, anything bigger isn't one
+        static const size_t MaxRequestBytes = 1024 * 1024;
+
+#if !defined(TP_SERVER_UNSUPPORTED)
+        static bool makeAddress(const fs::path& socketPath, sockaddr_un& address)
+        {
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            std::string path = socketPath.string();
+            if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            return true;
+        }
+        // -1 if nobody is listening
+        static int connectTo(const fs::path& socketPath)
+        {
+            sockaddr_un address;
+            if (!makeAddress(socketPath, address)) return -1;
+            int handle = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (handle < 0) return -1;
+            if (connect(handle, (const sockaddr*)&address, sizeof(address)) != 0) {
+                close(handle);
+                return -1;
+            }
+            return handle;
+        }
+        static bool sendAll(int handle, const std::string& data)
+        {
+            for (size_t sent = 0; sent < data.size();) {
+                ssize_t count = send(handle, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (count <= 0) return false;
+                sent += (size_t)count;
+            }
+            return true;
+        }
+        // reads until the other side stops writing
+        static bool receiveAll(int handle, std::string& data)
+        {
+            char buffer[4096];
+            while (true) {
+                ssize_t count = recv(handle, buffer, sizeof(buffer), 0);
+                if (count < 0) return false;
+                if (count == 0) return true;
+                data.append(buffer, (size_t)count);
+                if (data.size() > MaxRequestBytes) return false;
+            }
+        }
+#endif
+
+        PackerServer::PackerServer(fs::path socketPath, int threadCount, size_t imageCacheBytes)
+            : socketPath(std::move(socketPath)),
+            pool(std::make_shared<ThreadPool>(threadCount)),
+            images(std::make_shared<ImageCache>(imageCacheBytes))
+        {
+        }
+        PackerServer::~PackerServer()
+        {
+#if !defined(TP_SERVER_UNSUPPORTED)
+            if (listenHandle >= 0) close(listenHandle);
+#endif
+        }
+
+        bool PackerServer::Serve()
+        {
+#if defined(TP_SERVER_UNSUPPORTED)
+            cerr << "[Error] The server needs Unix domain sockets, which this platform doesn't have" << endl;
+            return false;
+#else
+            sockaddr_un address;
+            if (!makeAddress(socketPath, address)) {
+                cerr << "[Error] Invalid socket path (" << socketPath << "). It has to be shorter than " << sizeof(address.sun_path) << " characters" << endl;
+                return false;
+            }
+            // a socket file nobody answers on was left behind by a server that died
+            int running = connectTo(socketPath);
+            if (running >= 0) {
+                close(running);
+                cerr << "[Error] A server is already listening on " << socketPath << endl;
+                return false;
+            }
+            std::error_code error;
+            if (fs::is_socket(socketPath, error)) fs::remove(socketPath, error);
+
+            // a client hanging up before its reply must not kill the server
+            std::signal(SIGPIPE, SIG_IGN);
+            listenHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listenHandle < 0 || bind(listenHandle, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listenHandle, 64) != 0) {
+                cerr << "[Error] Failed to listen on " << socketPath << ": " << std::strerror(errno) << endl;
+                return false;
+            }
+            cout << "[Info] Server listening on " << socketPath << " with " << pool->Size() << " thread(s)" << endl;
+
+            while (!stopping) {
+                int connection = accept(listenHandle, nullptr, nullptr);
+                if (connection < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    cerr << "[Error] Failed to accept a connection: " << std::strerror(errno) << endl;
+                    break;
+                }
+                if (stopping) {
+                    close(connection);
+                    break;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(jobsMutex);
+                    activeJobs++;
+                }
+                std::thread(&PackerServer::handleConnection, this, connection).detach();
+            }
+
+            // the jobs that were accepted still get their reply
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsDone.wait(lock, [this] { return activeJobs == 0; });
+            close(listenHandle);
+            listenHandle = -1;
+            fs::remove(socketPath, error);
+            cout << "[Info] Server stopped" << endl;
+            return true;
+#endif
+        }
+
+        void PackerServer::handleConnection(int connection)
+        {
+#if !defined(TP_SERVER_UNSUPPORTED)
+            std::string request, reply;
+            if (receiveAll(connection, request)) reply = handleRequest(request);
+            else reply = nlohmann::json{ {"ok", false}, {"error", "Failed to read the request"} }.dump();
+            sendAll(connection, reply);
+            close(connection);
+
+            // a stop request wakes the accept loop up with a connection of its own
+            if (stopping) {
+                int wakeUp = connectTo(socketPath);
+                if (wakeUp >= 0) close(wakeUp);
+            }
+#endif
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            activeJobs--;
+            jobsDone.notify_all();
+        }
+
+        std::string PackerServer::handleRequest(const std::string& request)
+        {
+            nlohmann::json reply;
+            try {
+                nlohmann::json json = nlohmann::json::parse(request);
+                std::string command = json.value("command", "");
+                if (command == "run") return runJob(json.at("args").get<std::vector<std::string>>());
+                if (command == "status") {
+                    std::lock_guard<std::mutex> lock(jobsMutex);
+                    reply = {
+                        {"ok", true},
+                        // this request is one of them
+                        {"jobs", activeJobs - 1},
+                        {"threads", pool->Size()},
+                        {"images", images->Count()},
+                        {"imageBytes", images->Bytes()}
+                    };
+                }
+                else if (command == "stop") {
+                    stopping = true;
+                    reply = { {"ok", true} };
+                }
+                else reply = { {"ok", false}, {"error", "Unknown command: " + command} };
+            }
+            catch (const std::exception& e) {
+                reply = { {"ok", false}, {"error", std::string("Invalid request: ") + e.what()} };
+            }
+            return reply.dump();
+        }
+
+        std::shared_ptr<std::mutex> PackerServer::groupLock(const std::vector<std::string>& args)
+        {
+            std::string output, group = PackingSettings().Group;
+            for (const auto& arg : args) {
+                // a project writes the groups of its file, which aren't known here
+                if (arg.starts_with("-project=")) return nullptr;
+                if (arg.starts_with("-o=")) output = arg.substr(3);
+                else if (arg.starts_with("-group=")) group = arg.substr(7);
+            }
+            // a job without an output folder has nothing to write
+            if (output.empty()) return nullptr;
+            std::string key = fs::absolute(output).lexically_normal().string() + "|" + group;
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            auto& found = groupLocks[key];
+            if (!found) found = std::make_shared<std::mutex>();
+            return found;
+        }
+
+        std::string PackerServer::runJob(const std::vector<std::string>& args)
+        {
+            for (const auto& arg : args) {
+                // a job has to end for its reply to be sent
+                if (arg == "-watch" || arg.starts_with("-server=") || arg.starts_with("-client=")) {
+                    return nlohmann::json{ {"ok", false}, {"error", arg + " can't be used in a server job"} }.dump();
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            bool ok;
+            {
+                auto lock = groupLock(args);
+                std::unique_lock<std::mutex> writing;
+                if (lock) writing = std::unique_lock<std::mutex>(*lock);
+                TexturePacker packer;
+                packer.SetThreadPool(pool);
+                packer.SetImageCache(images);
+                ok = packer.Run(args);
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            nlohmann::json reply = { {"ok", ok}, {"milliseconds", elapsed.count()} };
+            if (!ok) reply["error"] = "The job failed. See the server log";
+            return reply.dump();
+        }
+
+        bool PackerServer::Submit(const fs::path& socketPath, std::vector<std::string> args)
+        {
+#if defined(TP_SERVER_UNSUPPORTED)
+            cerr << "[Error] The server needs Unix domain sockets, which this platform doesn't have" << endl;
+            return false;
+#else
+            nlohmann::json request;
+            if (args.size() == 1 && args[0] == "-stop") request = { {"command", "stop"} };
+            else if (args.size() == 1 && args[0] == "-status") request = { {"command", "status"} };
+            else {
+                // the server runs in another folder
+                for (auto& arg : args) {
+                    for (const char* option : { "-i=", "-o=", "-pivot=", "-cache-dir=", "-project=", "-stats=", "-trace=" }) {
+                        if (!arg.starts_with(option)) continue;
+                        std::string path = arg.substr(std::strlen(option));
+                        if (!path.empty()) arg = option + fs::absolute(path).lexically_normal().string();
+                    }
+                }
+                request = { {"command", "run"}, {"args", args} };
+            }
+
+            int handle = connectTo(socketPath);
+            if (handle < 0) {
+                cerr << "[Error] No server is listening on " << socketPath << ". Start one with -server=" << socketPath.string() << endl;
+                return false;
+            }
+            std::string reply;
+            bool sent = sendAll(handle, request.dump()) && shutdown(handle, SHUT_WR) == 0 && receiveAll(handle, reply);
+            close(handle);
+            if (!sent || reply.empty()) {
+                cerr << "[Error] The server on " << socketPath << " hung up without replying" << endl;
+                return false;
+            }
+
+            nlohmann::json json = nlohmann::json::parse(reply, nullptr, false);
+            if (json.is_discarded() || !json.is_object()) {
+                cerr << "[Error] Invalid reply from the server: " << reply << endl;
+                return false;
+            }
+            bool ok = json.value("ok", false);
+            if (!ok) cerr << "[Error] " << json.value("error", std::string("The job failed")) << endl;
+            else if (json.contains("milliseconds")) cout << "[Info] Job finished on the server in " << json["milliseconds"].get<long long>() << " ms" << endl;
+            else if (json.contains("jobs")) {
+                cout << "[Info] Server on " << socketPath << ": " << json["jobs"].get<int>() << " job(s) running on "
+                    << json["threads"].get<int>() << " thread(s), " << json["images"].get<size_t>() << " image(s) in memory ("
+                    << json["imageBytes"].get<size_t>() / (1024 * 1024) << " MB)" << endl;
+            }
+            else cout << "[Info] Server on " << socketPath << " is stopping" << endl;
+            return ok;
+#endif
+        }
+    }
+}
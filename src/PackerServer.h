@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ImageCache.h"
+#include "ThreadPool.h"
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * Long running packer listening on a Unix domain socket
+        * every connection carries one JSON request and gets one JSON reply:
+        *   {"command": "run", "args": ["-p", "-i=...", "-o=..."]} runs the same options as the command line
+        *   {"command": "status"} reports the jobs running and the images in memory
+        *   {"command": "stop"} lets the running jobs finish and shuts the server down
+        * jobs run at the same time on one thread pool and share the decoded images, keyed by path, size and modified time
+        * jobs writing the same group to the same output folder run one after the other
+        */
+        class PackerServer
+        {
+        private:
+            std::filesystem::path socketPath;
+            std::shared_ptr<ThreadPool> pool;
+            std::shared_ptr<ImageCache> images;
+            int listenHandle = -1;
+            std::atomic<bool> stopping = false;
+
+            int activeJobs = 0;
+            std::mutex jobsMutex;
+            std::condition_variable jobsDone;
+            // output folder + group -> lock held while a job writes it
+            std::map<std::string, std::shared_ptr<std::mutex>> groupLocks;
+
+            void handleConnection(int connection);
+            // returns the reply to send back
+            std::string handleRequest(const std::string& request);
+            std::string runJob(const std::vector<std::string>& args);
+            // the lock of the group the job writes, null for jobs without -o= and for projects
+            std::shared_ptr<std::mutex> groupLock(const std::vector<std::string>& args);
+        public:
+            // threadCount 0 uses every hardware thread. imageCacheBytes 0 keeps every decoded image
+            PackerServer(std::filesystem::path socketPath, int threadCount, size_t imageCacheBytes);
+            ~PackerServer();
+            PackerServer(const PackerServer&) = delete;
+            PackerServer& operator=(const PackerServer&) = delete;
+
+            // accepts connections until a stop request. returns false if the socket couldn't be opened
+            bool Serve();
+
+            /*
+            * sends the options to the server listening on socketPath and waits for the job to finish
+            * "-stop" and "-status" send those commands instead. relative paths are resolved here
+            * returns true if the job succeeded
+            */
+            static bool Submit(const std::filesystem::path& socketPath, std::vector<std::string> args);
+        };
+    }
+}
@@ -0,0 +1,650 @@
+#include "PngWriter.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+
+namespace QLE {
+    namespace TextureTools {
+        namespace PngWriter {
+            namespace {
+                const int WindowSize = 32768;
+                const int WindowMask = WindowSize - 1;
+                const int HashBits = 15;
+                const int HashSize = 1 << HashBits;
+                const int MinMatch = 3;
+                const int MaxMatch = 258;
+                // tokens collected before a deflate block is emitted
+                const size_t BlockTokens = 1 << 15;
+                // bands smaller than this lose more ratio than they gain in speed
+                const size_t MinBandBytes = 256 * 1024;
+
+                const int LengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+                const int LengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+                const int DistanceBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+                const int DistanceExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+                // order in which the code length code lengths are stored
+                const int CodeLengthOrder[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+                // length/distance -> deflate symbol lookups and the CRC table, built once
+                struct Tables {
+                    uint8_t lengthSymbol[MaxMatch + 1];
+                    uint8_t distanceSymbol[WindowSize + 1];
+                    uint32_t crc[256];
+
+                    Tables() {
+                        for (int symbol = 0; symbol < 29; symbol++) {
+                            int last = symbol == 28 ? MaxMatch : LengthBase[symbol] + (1 << LengthExtra[symbol]) - 1;
+                            for (int length = LengthBase[symbol]; length <= last && length <= MaxMatch; length++)
+                                lengthSymbol[length] = (uint8_t)symbol;
+                        }
+                        // 258 has its own symbol even though 227 + 31 reaches it
+                        lengthSymbol[MaxMatch] = 28;
+                        for (int symbol = 0; symbol < 30; symbol++) {
+                            int last = DistanceBase[symbol] + (1 << DistanceExtra[symbol]) - 1;
+                            for (int distance = DistanceBase[symbol]; distance <= last && distance <= WindowSize; distance++)
+                                distanceSymbol[distance] = (uint8_t)symbol;
+                        }
+                        for (uint32_t n = 0; n < 256; n++) {
+                            uint32_t c = n;
+                            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                            crc[n] = c;
+                        }
+                    }
+                };
+                const Tables& tables() {
+                    static const Tables instance;
+                    return instance;
+                }
+
+                struct MatchParams {
+                    int maxChain;
+                    int niceLength;
+                    bool lazy;
+                };
+                MatchParams matchParamsForLevel(int level) {
+                    static const MatchParams params[10] = {
+                        { 0, 0, false },
+                        { 4, 16, false },
+                        { 8, 32, false },
+                        { 16, 32, false },
+                        { 16, 64, true },
+                        { 32, 128, true },
+                        { 64, 128, true },
+                        { 128, 258, true },
+                        { 256, 258, true },
+                        { 1024, 258, true },
+                    };
+                    return params[std::clamp(level, 0, 9)];
+                }
+
+                // deflate writes its bits starting from the least significant one
+                class BitWriter
+                {
+                private:
+                    std::vector<uint8_t>& out;
+                    uint64_t bits = 0;
+                    int count = 0;
+                public:
+                    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+                    void Put(uint32_t value, int length) {
+                        bits |= (uint64_t)value << count;
+                        count += length;
+                        while (count >= 8) {
+                            out.push_back((uint8_t)bits);
+                            bits >>= 8;
+                            count -= 8;
+                        }
+                    }
+                    void AlignToByte() {
+                        if (count > 0) out.push_back((uint8_t)bits);
+                        bits = 0;
+                        count = 0;
+                    }
+                };
+
+                // a literal when distance is 0, otherwise a match
+                struct Token {
+                    uint16_t length;
+                    uint16_t distance;
+                };
+
+                struct Huffman {
+                    std::vector<uint8_t> lengths;
+                    // bit reversed, ready for BitWriter
+                    std::vector<uint16_t> codes;
+                };
+                // canonical codes from the code lengths
+                void buildCodes(Huffman& huffman) {
+                    int lengthCount[16] = {};
+                    for (uint8_t length : huffman.lengths) lengthCount[length]++;
+                    lengthCount[0] = 0;
+                    int nextCode[16] = {};
+                    for (int bits = 1, code = 0; bits < 16; bits++) {
+                        code = (code + lengthCount[bits - 1]) << 1;
+                        nextCode[bits] = code;
+                    }
+                    huffman.codes.assign(huffman.lengths.size(), 0);
+                    for (size_t symbol = 0; symbol < huffman.lengths.size(); symbol++) {
+                        int length = huffman.lengths[symbol];
+                        if (length == 0) continue;
+                        uint32_t code = nextCode[length]++;
+                        uint32_t reversed = 0;
+                        for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+                        huffman.codes[symbol] = (uint16_t)reversed;
+                    }
+                }
+                // huffman code lengths no longer than maxBits. halves the frequencies until the tree is shallow enough
+                Huffman buildHuffman(std::vector<uint32_t> freq, int maxBits) {
+                    Huffman huffman;
+                    huffman.lengths.assign(freq.size(), 0);
+                    while (true) {
+                        std::vector<int> leaves;
+                        for (size_t i = 0; i < freq.size(); i++) if (freq[i]) leaves.push_back((int)i);
+                        if (leaves.size() == 1) huffman.lengths[leaves[0]] = 1;
+                        if (leaves.size() <= 1) break;
+
+                        // nodes [0, leaves) are leaves, the rest are internal nodes in creation order
+                        std::vector<int> parent(leaves.size() * 2 - 1, -1);
+                        using Node = std::pair<uint64_t, int>;
+                        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+                        for (size_t i = 0; i < leaves.size(); i++) queue.push({ freq[leaves[i]], (int)i });
+                        int next = (int)leaves.size();
+                        while (queue.size() > 1) {
+                            Node a = queue.top(); queue.pop();
+                            Node b = queue.top(); queue.pop();
+                            parent[a.second] = parent[b.second] = next;
+                            queue.push({ a.first + b.first, next++ });
+                        }
+                        std::vector<int> depth(parent.size(), 0);
+                        for (int node = next - 2; node >= 0; node--) depth[node] = depth[parent[node]] + 1;
+
+                        int deepest = 0;
+                        for (size_t i = 0; i < leaves.size(); i++) deepest = std::max(deepest, depth[i]);
+                        if (deepest <= maxBits) {
+                            for (size_t i = 0; i < leaves.size(); i++) huffman.lengths[leaves[i]] = (uint8_t)depth[i];
+                            break;
+                        }
+                        for (auto& f : freq) if (f) f = (f + 1) / 2;
+                    }
+                    buildCodes(huffman);
+                    return huffman;
+                }
+                const Huffman& fixedLiteralCodes() {
+                    static const Huffman fixed = [] {
+                        Huffman huffman;
+                        huffman.lengths.assign(288, 8);
+                        std::fill(huffman.lengths.begin() + 144, huffman.lengths.begin() + 256, 9);
+                        std::fill(huffman.lengths.begin() + 256, huffman.lengths.begin() + 280, 7);
+                        buildCodes(huffman);
+                        return huffman;
+                    }();
+                    return fixed;
+                }
+                const Huffman& fixedDistanceCodes() {
+                    static const Huffman fixed = [] {
+                        Huffman huffman;
+                        huffman.lengths.assign(30, 5);
+                        buildCodes(huffman);
+                        return huffman;
+                    }();
+                    return fixed;
+                }
+
+                // run length encoded code lengths of a dynamic block header
+                struct CodeLengthSymbol {
+                    uint8_t symbol;
+                    uint8_t extra;
+                };
+                std::vector<CodeLengthSymbol> runLengthEncode(const std::vector<uint8_t>& lengths) {
+                    std::vector<CodeLengthSymbol> symbols;
+                    size_t i = 0;
+                    while (i < lengths.size()) {
+                        uint8_t current = lengths[i];
+                        size_t run = 1;
+                        while (i + run < lengths.size() && lengths[i + run] == current) run++;
+                        i += run;
+                        if (current == 0) {
+                            while (run >= 11) {
+                                size_t repeat = std::min<size_t>(run, 138);
+                                symbols.push_back({ 18, (uint8_t)(repeat - 11) });
+                                run -= repeat;
+                            }
+                            if (run >= 3) {
+                                symbols.push_back({ 17, (uint8_t)(run - 3) });
+                                run = 0;
+                            }
+                        }
+                        else {
+                            symbols.push_back({ current, 0 });
+                            run--;
+                            while (run >= 3) {
+                                size_t repeat = std::min<size_t>(run, 6);
+                                symbols.push_back({ 16, (uint8_t)(repeat - 3) });
+                                run -= repeat;
+                            }
+                        }
+                        while (run-- > 0) symbols.push_back({ current, 0 });
+                    }
+                    return symbols;
+                }
+                int codeLengthExtraBits(int symbol) {
+                    return symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0;
+                }
+
+                void writeStored(BitWriter& writer, const uint8_t* data, size_t length, bool final) {
+                    do {
+                        size_t chunk = std::min<size_t>(length, 65535);
+                        length -= chunk;
+                        writer.Put(final && length == 0 ? 1 : 0, 1);
+                        writer.Put(0, 2);
+                        writer.AlignToByte();
+                        writer.Put((uint32_t)chunk, 16);
+                        writer.Put((uint32_t)~chunk & 0xFFFF, 16);
+                        for (size_t i = 0; i < chunk; i++) writer.Put(data[i], 8);
+                        data += chunk;
+                    } while (length > 0);
+                }
+                void writeTokens(BitWriter& writer, const std::vector<Token>& tokens, const Huffman& literals, const Huffman& distances) {
+                    const Tables& lookup = tables();
+                    for (const Token& token : tokens) {
+                        if (token.distance == 0) {
+                            writer.Put(literals.codes[token.length], literals.lengths[token.length]);
+                            continue;
+                        }
+                        int lengthSymbol = lookup.lengthSymbol[token.length];
+                        writer.Put(literals.codes[257 + lengthSymbol], literals.lengths[257 + lengthSymbol]);
+                        writer.Put(token.length - LengthBase[lengthSymbol], LengthExtra[lengthSymbol]);
+                        int distanceSymbol = lookup.distanceSymbol[token.distance];
+                        writer.Put(distances.codes[distanceSymbol], distances.lengths[distanceSymbol]);
+                        writer.Put(token.distance - DistanceBase[distanceSymbol], DistanceExtra[distanceSymbol]);
+                    }
+                    writer.Put(literals.codes[256], literals.lengths[256]);
+                }
+                // emits the tokens as whichever block type is the smallest: stored, fixed or dynamic huffman
+                void writeBlock(BitWriter& writer, const std::vector<Token>& tokens, const uint8_t* raw, size_t rawLength, bool final) {
+                    const Tables& lookup = tables();
+                    std::vector<uint32_t> literalFreq(286, 0), distanceFreq(30, 0);
+                    uint64_t extraBits = 0;
+                    for (const Token& token : tokens) {
+                        if (token.distance == 0) {
+                            literalFreq[token.length]++;
+                            continue;
+                        }
+                        int lengthSymbol = lookup.lengthSymbol[token.length];
+                        int distanceSymbol = lookup.distanceSymbol[token.distance];
+                        literalFreq[257 + lengthSymbol]++;
+                        distanceFreq[distanceSymbol]++;
+                        extraBits += LengthExtra[lengthSymbol] + DistanceExtra[distanceSymbol];
+                    }
+                    literalFreq[256] = 1;
+                    // some decoders reject trees with less than two codes
+                    int usedDistances = (int)std::count_if(distanceFreq.begin(), distanceFreq.end(), [](uint32_t f) { return f > 0; });
+                    for (int i = 0; usedDistances < 2; i++) {
+                        if (distanceFreq[i]) continue;
+                        distanceFreq[i] = 1;
+                        usedDistances++;
+                    }
+
+                    Huffman literals = buildHuffman(literalFreq, 15);
+                    Huffman distances = buildHuffman(distanceFreq, 15);
+                    int literalCount = 286, distanceCount = 30;
+                    while (literalCount > 257 && literals.lengths[literalCount - 1] == 0) literalCount--;
+                    while (distanceCount > 1 && distances.lengths[distanceCount - 1] == 0) distanceCount--;
+                    std::vector<uint8_t> allLengths(literals.lengths.begin(), literals.lengths.begin() + literalCount);
+                    allLengths.insert(allLengths.end(), distances.lengths.begin(), distances.lengths.begin() + distanceCount);
+                    std::vector<CodeLengthSymbol> header = runLengthEncode(allLengths);
+                    std::vector<uint32_t> codeLengthFreq(19, 0);
+                    for (const auto& entry : header) codeLengthFreq[entry.symbol]++;
+                    Huffman codeLengths = buildHuffman(codeLengthFreq, 7);
+                    int codeLengthCount = 19;
+                    while (codeLengthCount > 4 && codeLengths.lengths[CodeLengthOrder[codeLengthCount - 1]] == 0) codeLengthCount--;
+
+                    // sizes in bits of each block type
+                    uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * codeLengthCount + extraBits;
+                    for (const auto& entry : header) dynamicBits += codeLengths.lengths[entry.symbol] + codeLengthExtraBits(entry.symbol);
+                    uint64_t fixedBits = 3 + extraBits;
+                    const Huffman& fixedLiterals = fixedLiteralCodes();
+                    for (int symbol = 0; symbol < 286; symbol++) {
+                        dynamicBits += (uint64_t)literalFreq[symbol] * literals.lengths[symbol];
+                        fixedBits += (uint64_t)literalFreq[symbol] * fixedLiterals.lengths[symbol];
+                    }
+                    for (int symbol = 0; symbol < 30; symbol++) {
+                        dynamicBits += (uint64_t)distanceFreq[symbol] * distances.lengths[symbol];
+                        fixedBits += (uint64_t)distanceFreq[symbol] * 5;
+                    }
+                    uint64_t storedBits = rawLength * 8 + ((rawLength + 65534) / 65535 + 1) * 40;
+
+                    if (storedBits <= fixedBits && storedBits <= dynamicBits) {
+                        writeStored(writer, raw, rawLength, final);
+                        return;
+                    }
+                    writer.Put(final ? 1 : 0, 1);
+                    if (fixedBits <= dynamicBits) {
+                        writer.Put(1, 2);
+                        writeTokens(writer, tokens, fixedLiterals, fixedDistanceCodes());
+                        return;
+                    }
+                    writer.Put(2, 2);
+                    writer.Put(literalCount - 257, 5);
+                    writer.Put(distanceCount - 1, 5);
+                    writer.Put(codeLengthCount - 4, 4);
+                    for (int i = 0; i < codeLengthCount; i++) writer.Put(codeLengths.lengths[CodeLengthOrder[i]], 3);
+                    for (const auto& entry : header) {
+                        writer.Put(codeLengths.codes[entry.symbol], codeLengths.lengths[entry.symbol]);
+                        writer.Put(entry.extra, codeLengthExtraBits(entry.symbol));
+                    }
+                    writeTokens(writer, tokens, literals, distances);
+                }
+
+                inline int matchLength(const uint8_t* a, const uint8_t* b, int maxLength) {
+                    int length = 0;
+                    while (length + 8 <= maxLength) {
+                        uint64_t x, y;
+                        std::memcpy(&x, a + length, 8);
+                        std::memcpy(&y, b + length, 8);
+                        if (x != y) return length + std::countr_zero(x ^ y) / 8;
+                        length += 8;
+                    }
+                    while (length < maxLength && a[length] == b[length]) length++;
+                    return length;
+                }
+
+                /*
+                * deflates data[start, end) as raw deflate blocks. up to 32KB before start are used as the dictionary,
+                * the decoder has them in its window already since they belong to the previous band
+                * a band that isn't the last one ends with an empty stored block so the next band starts on a byte
+                */
+                void deflateBand(const uint8_t* data, size_t start, size_t end, const MatchParams& params, bool final, std::vector<uint8_t>& out) {
+                    BitWriter writer(out);
+                    if (params.maxChain == 0) {
+                        writeStored(writer, data + start, end - start, final);
+                        if (!final) writeStored(writer, nullptr, 0, false);
+                        writer.AlignToByte();
+                        return;
+                    }
+
+                    size_t dictionaryStart = start - std::min<size_t>(start, WindowSize);
+                    const uint8_t* base = data + dictionaryStart;
+                    const int length = (int)(end - dictionaryStart);
+                    const int begin = (int)(start - dictionaryStart);
+
+                    std::vector<int32_t> head(HashSize, -1), previous(WindowSize, -1);
+                    auto hashAt = [&](int p) {
+                        return (int)((((uint32_t)base[p] << 10) ^ ((uint32_t)base[p + 1] << 5) ^ base[p + 2]) * 2654435761u >> (32 - HashBits));
+                    };
+                    auto insert = [&](int p) {
+                        if (p + MinMatch > length) return;
+                        int hash = hashAt(p);
+                        previous[p & WindowMask] = head[hash];
+                        head[hash] = p;
+                    };
+                    auto findMatch = [&](int p, int& bestDistance) {
+                        bestDistance = 0;
+                        if (p + MinMatch > length) return 0;
+                        int maxLength = std::min(MaxMatch, length - p);
+                        int bestLength = MinMatch - 1;
+                        int candidate = head[hashAt(p)];
+                        for (int chain = params.maxChain; candidate >= 0 && chain > 0; chain--) {
+                            int distance = p - candidate;
+                            if (distance <= 0 || distance > WindowSize) break;
+                            if (base[candidate + bestLength] == base[p + bestLength]) {
+                                int matched = matchLength(base + candidate, base + p, maxLength);
+                                if (matched > bestLength) {
+                                    bestLength = matched;
+                                    bestDistance = distance;
+                                    if (matched >= params.niceLength || matched == maxLength) break;
+                                }
+                            }
+                            int next = previous[candidate & WindowMask];
+                            if (next >= candidate) break;
+                            candidate = next;
+                        }
+                        return bestLength >= MinMatch ? bestLength : 0;
+                    };
+
+                    for (int p = 0; p < begin; p++) insert(p);
+
+                    std::vector<Token> tokens;
+                    tokens.reserve(BlockTokens);
+                    int blockStart = begin;
+                    auto flush = [&](int p, bool last) {
+                        writeBlock(writer, tokens, base + blockStart, p - blockStart, last);
+                        tokens.clear();
+                        blockStart = p;
+                    };
+
+                    int p = begin;
+                    int distance = 0;
+                    int matched = findMatch(p, distance);
+                    while (p < length) {
+                        if (matched && params.lazy && matched < params.niceLength) {
+                            // a longer match one byte later is worth a literal
+                            insert(p);
+                            int nextDistance;
+                            int nextMatched = findMatch(p + 1, nextDistance);
+                            if (nextMatched > matched) {
+                                tokens.push_back({ base[p], 0 });
+                                p++;
+                                matched = nextMatched;
+                                distance = nextDistance;
+                                if (tokens.size() >= BlockTokens) flush(p, false);
+                                continue;
+                            }
+                            tokens.push_back({ (uint16_t)matched, (uint16_t)distance });
+                            for (int i = 1; i < matched; i++) insert(p + i);
+                            p += matched;
+                        }
+                        else if (matched) {
+                            tokens.push_back({ (uint16_t)matched, (uint16_t)distance });
+                            for (int i = 0; i < matched; i++) insert(p + i);
+                            p += matched;
+                        }
+                        else {
+                            tokens.push_back({ base[p], 0 });
+                            insert(p);
+                            p++;
+                        }
+                        if (tokens.size() >= BlockTokens && p < length) flush(p, false);
+                        matched = findMatch(p, distance);
+                    }
+                    flush(length, final);
+                    if (!final) writeStored(writer, nullptr, 0, false);
+                    writer.AlignToByte();
+                }
+
+                uint32_t adler32(const uint8_t* data, size_t length) {
+                    const uint32_t Base = 65521;
+                    uint32_t a = 1, b = 0;
+                    while (length > 0) {
+                        // largest block that can't overflow before the modulo
+                        size_t block = std::min<size_t>(length, 5552);
+                        length -= block;
+                        while (block--) {
+                            a += *data++;
+                            b += a;
+                        }
+                        a %= Base;
+                        b %= Base;
+                    }
+                    return (b << 16) | a;
+                }
+                // adler32 of two joined buffers from the adler32 of each one
+                uint32_t adler32Combine(uint32_t first, uint32_t second, size_t secondLength) {
+                    const uint32_t Base = 65521;
+                    uint32_t remainder = (uint32_t)(secondLength % Base);
+                    uint32_t sum1 = first & 0xFFFF;
+                    uint32_t sum2 = (uint32_t)(((uint64_t)remainder * sum1) % Base);
+                    sum1 += (second & 0xFFFF) + Base - 1;
+                    sum2 += ((first >> 16) & 0xFFFF) + ((second >> 16) & 0xFFFF) + Base - remainder;
+                    if (sum1 >= Base) sum1 -= Base;
+                    if (sum1 >= Base) sum1 -= Base;
+                    if (sum2 >= (Base << 1)) sum2 -= (Base << 1);
+                    if (sum2 >= Base) sum2 -= Base;
+                    return sum1 | (sum2 << 16);
+                }
+                uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length) {
+                    const Tables& lookup = tables();
+                    crc = ~crc;
+                    for (size_t i = 0; i < length; i++) crc = lookup.crc[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+                    return ~crc;
+                }
+
+                inline uint8_t paeth(int a, int b, int c) {
+                    int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    if (pa <= pb && pa <= pc) return (uint8_t)a;
+                    if (pb <= pc) return (uint8_t)b;
+                    return (uint8_t)c;
+                }
+                // applies one filter to a row. prior is null for the first row
+                void filterRow(Filter filter, const uint8_t* row, const uint8_t* prior, int rowBytes, int bytesPerPixel, uint8_t* out) {
+                    for (int i = 0; i < rowBytes; i++) {
+                        int a = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+                        int b = prior ? prior[i] : 0;
+                        int c = prior && i >= bytesPerPixel ? prior[i - bytesPerPixel] : 0;
+                        switch (filter) {
+                        case Filter::Sub: out[i] = (uint8_t)(row[i] - a); break;
+                        case Filter::Up: out[i] = (uint8_t)(row[i] - b); break;
+                        case Filter::Average: out[i] = (uint8_t)(row[i] - ((a + b) >> 1)); break;
+                        case Filter::Paeth: out[i] = (uint8_t)(row[i] - paeth(a, b, c)); break;
+                        default: out[i] = row[i]; break;
+                        }
+                    }
+                }
+                // filter type byte followed by the filtered row
+                void encodeRow(Filter filter, const uint8_t* row, const uint8_t* prior, int rowBytes, int bytesPerPixel, uint8_t* out, std::vector<uint8_t>& scratch) {
+                    if (filter != Filter::Adaptive) {
+                        out[0] = (uint8_t)filter;
+                        filterRow(filter, row, prior, rowBytes, bytesPerPixel, out + 1);
+                        return;
+                    }
+                    // same heuristic as libpng: the filter with the smallest sum of signed bytes
+                    scratch.resize(rowBytes);
+                    uint64_t bestCost = UINT64_MAX;
+                    for (Filter candidate : { Filter::None, Filter::Sub, Filter::Up, Filter::Average, Filter::Paeth }) {
+                        filterRow(candidate, row, prior, rowBytes, bytesPerPixel, scratch.data());
+                        uint64_t cost = 0;
+                        for (int i = 0; i < rowBytes; i++) cost += std::abs((int8_t)scratch[i]);
+                        if (cost >= bestCost) continue;
+                        bestCost = cost;
+                        out[0] = (uint8_t)candidate;
+                        std::memcpy(out + 1, scratch.data(), rowBytes);
+                    }
+                }
+
+                void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+                    out.push_back((uint8_t)(value >> 24));
+                    out.push_back((uint8_t)(value >> 16));
+                    out.push_back((uint8_t)(value >> 8));
+                    out.push_back((uint8_t)value);
+                }
+                void writeChunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, size_t length) {
+                    putBigEndian(png, (uint32_t)length);
+                    size_t typeStart = png.size();
+                    png.insert(png.end(), type, type + 4);
+                    if (length) png.insert(png.end(), data, data + length);
+                    putBigEndian(png, crc32(0, png.data() + typeStart, length + 4));
+                }
+
+                std::vector<uint8_t> encode(const uint8_t* pixels, int width, int height, int bytesPerPixel, uint8_t colorType,
+                    const std::vector<std::pair<const char*, std::vector<uint8_t>>>& extraChunks, const Options& options, ThreadPool& pool) {
+                    const int rowBytes = width * bytesPerPixel;
+                    const size_t filteredRowBytes = (size_t)rowBytes + 1;
+                    std::vector<uint8_t> filtered(filteredRowBytes * height);
+
+                    // bands are whole rows so the filter pass and the deflate pass split the same way
+                    size_t bandCount = std::clamp<size_t>(std::min<size_t>(options.threads, filtered.size() / MinBandBytes), 1, height);
+                    size_t rowsPerBand = (height + bandCount - 1) / bandCount;
+                    bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+
+                    pool.ParallelFor(bandCount, [&](size_t band) {
+                        std::vector<uint8_t> scratch;
+                        int first = (int)(band * rowsPerBand), last = std::min(height, (int)((band + 1) * rowsPerBand));
+                        for (int y = first; y < last; y++) {
+                            const uint8_t* row = pixels + (size_t)y * rowBytes;
+                            encodeRow(options.filter, row, y > 0 ? row - rowBytes : nullptr, rowBytes, bytesPerPixel,
+                                filtered.data() + y * filteredRowBytes, scratch);
+                        }
+                    });
+
+                    MatchParams params = matchParamsForLevel(options.level);
+                    std::vector<std::vector<uint8_t>> compressed(bandCount);
+                    std::vector<uint32_t> checksums(bandCount);
+                    pool.ParallelFor(bandCount, [&](size_t band) {
+                        size_t start = band * rowsPerBand * filteredRowBytes;
+                        size_t end = std::min(filtered.size(), (band + 1) * rowsPerBand * filteredRowBytes);
+                        deflateBand(filtered.data(), start, end, params, band + 1 == bandCount, compressed[band]);
+                        checksums[band] = adler32(filtered.data() + start, end - start);
+                    });
+
+                    // zlib stream: header, the bands back to back, adler32 of everything
+                    std::vector<uint8_t> zlib = { 0x78, (uint8_t)(options.level <= 1 ? 0x01 : options.level < 6 ? 0x5E : options.level == 6 ? 0x9C : 0xDA) };
+                    uint32_t checksum = 1;
+                    for (size_t band = 0; band < bandCount; band++) {
+                        zlib.insert(zlib.end(), compressed[band].begin(), compressed[band].end());
+                        size_t start = band * rowsPerBand * filteredRowBytes;
+                        size_t end = std::min(filtered.size(), (band + 1) * rowsPerBand * filteredRowBytes);
+                        checksum = adler32Combine(checksum, checksums[band], end - start);
+                    }
+                    putBigEndian(zlib, checksum);
+
+                    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+                    std::vector<uint8_t> header;
+                    putBigEndian(header, (uint32_t)width);
+                    putBigEndian(header, (uint32_t)height);
+                    header.insert(header.end(), { 8, colorType, 0, 0, 0 });
+                    writeChunk(png, "IHDR", header.data(), header.size());
+                    for (const auto& [type, data] : extraChunks) writeChunk(png, type, data.data(), data.size());
+                    writeChunk(png, "IDAT", zlib.data(), zlib.size());
+                    writeChunk(png, "IEND", nullptr, 0);
+                    return png;
+                }
+            }
+
+            const char* FilterName(Filter filter)
+            {
+                switch (filter) {
+                case Filter::None: return "none";
+                case Filter::Sub: return "sub";
+                case Filter::Up: return "up";
+                case Filter::Average: return "avg";
+                case Filter::Paeth: return "paeth";
+                default: return "adaptive";
+                }
+            }
+            bool ParseFilter(const std::string& name, Filter& filter)
+            {
+                for (Filter candidate : { Filter::None, Filter::Sub, Filter::Up, Filter::Average, Filter::Paeth, Filter::Adaptive }) {
+                    if (name != FilterName(candidate)) continue;
+                    filter = candidate;
+                    return true;
+                }
+                return false;
+            }
+
+            std::vector<uint8_t> EncodeRGBA(const uint8_t* pixels, int width, int height, const Options& options, ThreadPool& pool)
+            {
+                return encode(pixels, width, height, 4, 6, {}, options, pool);
+            }
+            std::vector<uint8_t> EncodeIndexed(const uint8_t* indices, int width, int height,
+                const std::vector<uint8_t>& palette, const Options& options, ThreadPool& pool)
+            {
+                Options indexed = options;
+                if (indexed.filter == Filter::Adaptive) indexed.filter = Filter::None;
+
+                std::vector<uint8_t> colors, alpha;
+                for (size_t i = 0; i + 3 < palette.size(); i += 4) {
+                    colors.insert(colors.end(), palette.begin() + i, palette.begin() + i + 3);
+                    alpha.push_back(palette[i + 3]);
+                }
+                // tRNS can stop at the last translucent entry, the rest are opaque
+                while (!alpha.empty() && alpha.back() == 255) alpha.pop_back();
+                std::vector<std::pair<const char*, std::vector<uint8_t>>> chunks = { { "PLTE", colors } };
+                if (!alpha.empty()) chunks.push_back({ "tRNS", alpha });
+                return encode(indices, width, height, 1, 3, chunks, indexed, pool);
+            }
+        }
+    }
+}
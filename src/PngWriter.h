@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * PNG encoder that can split an image into row bands and deflate them in parallel
+        * every band is primed with the 32KB before it and ends on a sync flush, so the bands
+        * join into a single regular zlib stream that any decoder can read
+        */
+        namespace PngWriter {
+            // PNG row filters. Adaptive picks the best one for every row
+            enum class Filter {
+                None,
+                Sub,
+                Up,
+                Average,
+                Paeth,
+                Adaptive
+            };
+            const int DefaultLevel = 8;
+
+            struct Options {
+                // 0 stores the data uncompressed, 9 searches the longest matches
+                int level = DefaultLevel;
+                Filter filter = Filter::Adaptive;
+                // amount of bands compressed at the same time
+                int threads = 1;
+            };
+
+            // name used by -png-filter and the .json
+            const char* FilterName(Filter filter);
+            // returns false if the name doesn't match any filter
+            bool ParseFilter(const std::string& name, Filter& filter);
+
+            // encodes 8 bit RGBA pixels into a complete .png file in memory
+            std::vector<uint8_t> EncodeRGBA(const uint8_t* pixels, int width, int height, const Options& options, ThreadPool& pool);
+            /*
+            * encodes one palette index per pixel into an 8 bit indexed .png
+            * palette holds RGBA entries. adaptive uses no filter since filtering indices rarely helps
+            */
+            std::vector<uint8_t> EncodeIndexed(const uint8_t* indices, int width, int height,
+                const std::vector<uint8_t>& palette, const Options& options, ThreadPool& pool);
+        }
+    }
+}
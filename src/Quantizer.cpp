@@ -0,0 +1,305 @@
+#include "Quantizer.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <unordered_map>
+
+namespace QLE {
+    namespace TextureTools {
+        namespace Quantizer {
+            namespace {
+                // work is split into fixed chunks so the result doesn't depend on the thread count
+                const int ChunkRows = 64;
+                const size_t ChunkColors = 4096;
+                const int CacheBits = 12;
+
+                struct Color {
+                    uint8_t c[4];
+                    uint32_t count;
+                };
+                using Histogram = std::unordered_map<uint32_t, uint32_t>;
+
+                inline uint32_t pack(const uint8_t* c) {
+                    uint32_t key;
+                    std::memcpy(&key, c, 4);
+                    return key;
+                }
+                // every fully transparent pixel is the same color
+                inline uint32_t keyOf(const uint8_t* pixel) {
+                    return pixel[3] == 0 ? 0 : pack(pixel);
+                }
+                inline int distance(const uint8_t* a, const uint8_t* b) {
+                    int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2], da = a[3] - b[3];
+                    return dr * dr + dg * dg + db * db + da * da;
+                }
+
+                struct Box {
+                    size_t begin, end;
+                    int channel, range;
+                    uint64_t weight;
+                };
+                Box makeBox(const std::vector<Color>& colors, size_t begin, size_t end) {
+                    Box box{ begin, end, 0, 0, 0 };
+                    uint8_t low[4] = { 255, 255, 255, 255 }, high[4] = {};
+                    for (size_t i = begin; i < end; i++) {
+                        box.weight += colors[i].count;
+                        for (int c = 0; c < 4; c++) {
+                            low[c] = std::min(low[c], colors[i].c[c]);
+                            high[c] = std::max(high[c], colors[i].c[c]);
+                        }
+                    }
+                    for (int c = 0; c < 4; c++) {
+                        if (high[c] - low[c] <= box.range) continue;
+                        box.range = high[c] - low[c];
+                        box.channel = c;
+                    }
+                    return box;
+                }
+                // splits the box holding the most error until there are enough boxes
+                std::vector<Box> medianCut(std::vector<Color>& colors, int boxCount) {
+                    std::vector<Box> boxes;
+                    if (colors.empty()) return boxes;
+                    boxes.push_back(makeBox(colors, 0, colors.size()));
+                    while ((int)boxes.size() < boxCount) {
+                        int widest = -1;
+                        uint64_t widestScore = 0;
+                        for (int i = 0; i < (int)boxes.size(); i++) {
+                            uint64_t score = (uint64_t)boxes[i].range * boxes[i].weight;
+                            if (boxes[i].end - boxes[i].begin < 2 || score <= widestScore) continue;
+                            widest = i;
+                            widestScore = score;
+                        }
+                        if (widest < 0) break;
+
+                        Box box = boxes[widest];
+                        int channel = box.channel;
+                        std::sort(colors.begin() + box.begin, colors.begin() + box.end, [channel](const Color& a, const Color& b) {
+                            if (a.c[channel] != b.c[channel]) return a.c[channel] < b.c[channel];
+                            return pack(a.c) < pack(b.c);
+                        });
+                        // weighted median, leaving at least one color on each side
+                        size_t middle = box.begin + 1;
+                        uint64_t below = colors[box.begin].count;
+                        while (middle < box.end - 1 && below * 2 < box.weight) below += colors[middle++].count;
+                        boxes[widest] = makeBox(colors, box.begin, middle);
+                        boxes.push_back(makeBox(colors, middle, box.end));
+                    }
+                    return boxes;
+                }
+
+                // nearest color search over a palette sorted by green. the search stops once the green
+                // difference alone is further than the best match
+                class NearestColor
+                {
+                private:
+                    std::vector<std::array<uint8_t, 4>> colors;
+                    std::vector<uint8_t> indices;
+                    int transparentIndex = -1;
+                public:
+                    NearestColor(const std::vector<uint8_t>& palette, int transparentIndex) : transparentIndex(transparentIndex) {
+                        std::vector<int> order;
+                        for (int i = 0; i < (int)palette.size() / 4; i++) if (i != transparentIndex) order.push_back(i);
+                        std::sort(order.begin(), order.end(), [&](int a, int b) { return palette[a * 4 + 1] < palette[b * 4 + 1]; });
+                        for (int i : order) {
+                            colors.push_back({ palette[i * 4], palette[i * 4 + 1], palette[i * 4 + 2], palette[i * 4 + 3] });
+                            indices.push_back((uint8_t)i);
+                        }
+                    }
+                    int Find(const uint8_t* pixel) const {
+                        if (pixel[3] == 0 && transparentIndex >= 0) return transparentIndex;
+                        if (colors.empty()) return transparentIndex;
+                        int start = (int)(std::lower_bound(colors.begin(), colors.end(), pixel[1],
+                            [](const std::array<uint8_t, 4>& color, uint8_t green) { return color[1] < green; }) - colors.begin());
+                        int best = std::min(start, (int)colors.size() - 1);
+                        int bestDistance = distance(colors[best].data(), pixel);
+                        for (int up = start, down = start - 1; up < (int)colors.size() || down >= 0;) {
+                            if (up < (int)colors.size()) {
+                                int dg = colors[up][1] - pixel[1];
+                                if (dg * dg >= bestDistance) up = (int)colors.size();
+                                else {
+                                    int d = distance(colors[up].data(), pixel);
+                                    if (d < bestDistance) { bestDistance = d; best = up; }
+                                    up++;
+                                }
+                            }
+                            if (down >= 0) {
+                                int dg = pixel[1] - colors[down][1];
+                                if (dg * dg >= bestDistance) down = -1;
+                                else {
+                                    int d = distance(colors[down].data(), pixel);
+                                    if (d < bestDistance) { bestDistance = d; best = down; }
+                                    down--;
+                                }
+                            }
+                        }
+                        return indices[best];
+                    }
+                };
+                // sprites repeat the same colors a lot, a small direct mapped cache skips most searches
+                class CachedNearestColor
+                {
+                private:
+                    const NearestColor& nearest;
+                    std::vector<uint32_t> keys;
+                    std::vector<int16_t> values;
+                public:
+                    explicit CachedNearestColor(const NearestColor& nearest) : nearest(nearest), keys(1 << CacheBits), values(1 << CacheBits, -1) {}
+                    int Find(const uint8_t* pixel) {
+                        uint32_t key = pack(pixel);
+                        size_t slot = (key * 2654435761u) >> (32 - CacheBits);
+                        if (values[slot] >= 0 && keys[slot] == key) return values[slot];
+                        keys[slot] = key;
+                        values[slot] = (int16_t)nearest.Find(pixel);
+                        return values[slot];
+                    }
+                };
+
+                // k-means over the histogram. the transparent entry never moves
+                void refine(std::vector<uint8_t>& palette, const std::vector<Color>& colors, int transparentIndex, int iterations, ThreadPool& pool) {
+                    const int size = (int)palette.size() / 4;
+                    const size_t chunks = (colors.size() + ChunkColors - 1) / ChunkColors;
+                    for (int iteration = 0; iteration < iterations; iteration++) {
+                        NearestColor nearest(palette, transparentIndex);
+                        std::vector<std::vector<uint64_t>> sums(chunks, std::vector<uint64_t>((size_t)size * 5, 0));
+                        pool.ParallelFor(chunks, [&](size_t chunk) {
+                            std::vector<uint64_t>& sum = sums[chunk];
+                            size_t end = std::min(colors.size(), (chunk + 1) * ChunkColors);
+                            for (size_t i = chunk * ChunkColors; i < end; i++) {
+                                int index = nearest.Find(colors[i].c);
+                                for (int c = 0; c < 4; c++) sum[index * 5 + c] += (uint64_t)colors[i].c[c] * colors[i].count;
+                                sum[index * 5 + 4] += colors[i].count;
+                            }
+                        });
+                        bool moved = false;
+                        for (int index = 0; index < size; index++) {
+                            if (index == transparentIndex) continue;
+                            uint64_t total[5] = {};
+                            for (const auto& sum : sums)
+                                for (int c = 0; c < 5; c++) total[c] += sum[index * 5 + c];
+                            // nothing maps to it anymore, keep the old color
+                            if (total[4] == 0) continue;
+                            for (int c = 0; c < 4; c++) {
+                                uint8_t value = (uint8_t)((total[c] + total[4] / 2) / total[4]);
+                                moved |= palette[index * 4 + c] != value;
+                                palette[index * 4 + c] = value;
+                            }
+                        }
+                        if (!moved) break;
+                    }
+                }
+
+                void mapPixels(const uint8_t* pixels, int width, int height, const NearestColor& nearest, Result& result, ThreadPool& pool) {
+                    size_t chunks = (height + ChunkRows - 1) / ChunkRows;
+                    pool.ParallelFor(chunks, [&](size_t chunk) {
+                        CachedNearestColor cache(nearest);
+                        size_t first = chunk * ChunkRows * width, last = std::min<size_t>(height, (chunk + 1) * ChunkRows) * width;
+                        for (size_t i = first; i < last; i++) result.indices[i] = (uint8_t)cache.Find(pixels + i * 4);
+                    });
+                }
+                /*
+                * Floyd-Steinberg, going back and forth on every row
+                * every chunk of rows diffuses its own error so the chunks can run in parallel
+                * transparent pixels neither take nor pass any error so sprite borders stay clean
+                */
+                void ditherPixels(const uint8_t* pixels, int width, int height, const NearestColor& nearest,
+                    const std::vector<uint8_t>& palette, Result& result, ThreadPool& pool) {
+                    size_t chunks = (height + ChunkRows - 1) / ChunkRows;
+                    pool.ParallelFor(chunks, [&](size_t chunk) {
+                        CachedNearestColor cache(nearest);
+                        // error in 1/16ths, one pixel of padding on both sides
+                        std::vector<int> current((size_t)(width + 2) * 4, 0), next((size_t)(width + 2) * 4, 0);
+                        int first = (int)chunk * ChunkRows, last = std::min(height, first + ChunkRows);
+                        for (int y = first; y < last; y++) {
+                            bool reverse = (y - first) & 1;
+                            int step = reverse ? -1 : 1;
+                            std::fill(next.begin(), next.end(), 0);
+                            for (int i = 0; i < width; i++) {
+                                int x = reverse ? width - 1 - i : i;
+                                size_t pixel = (size_t)y * width + x;
+                                const uint8_t* source = pixels + pixel * 4;
+                                if (source[3] == 0) {
+                                    result.indices[pixel] = (uint8_t)nearest.Find(source);
+                                    continue;
+                                }
+                                int* error = &current[(x + 1) * 4];
+                                uint8_t wanted[4];
+                                for (int c = 0; c < 4; c++) wanted[c] = (uint8_t)std::clamp(source[c] + error[c] / 16, 0, 255);
+                                // dithering the alpha must not turn a visible pixel fully transparent
+                                wanted[3] = std::max<uint8_t>(wanted[3], 1);
+                                int index = cache.Find(wanted);
+                                result.indices[pixel] = (uint8_t)index;
+                                for (int c = 0; c < 4; c++) {
+                                    int diff = wanted[c] - palette[index * 4 + c];
+                                    current[(x + 1 + step) * 4 + c] += diff * 7;
+                                    next[(x + 1 - step) * 4 + c] += diff * 3;
+                                    next[(x + 1) * 4 + c] += diff * 5;
+                                    next[(x + 1 + step) * 4 + c] += diff;
+                                }
+                            }
+                            std::swap(current, next);
+                        }
+                    });
+                }
+            }
+
+            Result Quantize(const uint8_t* pixels, int width, int height, const Options& options, ThreadPool& pool)
+            {
+                const int target = std::clamp(options.colors, 2, MaxColors);
+                Result result;
+                result.indices.resize((size_t)width * height);
+
+                // histogram of every color, built per chunk of rows and merged
+                size_t chunks = (height + ChunkRows - 1) / ChunkRows;
+                std::vector<Histogram> partial(chunks);
+                pool.ParallelFor(chunks, [&](size_t chunk) {
+                    size_t first = chunk * ChunkRows * width, last = std::min<size_t>(height, (chunk + 1) * ChunkRows) * width;
+                    for (size_t i = first; i < last; i++) partial[chunk][keyOf(pixels + i * 4)]++;
+                });
+                Histogram histogram = std::move(partial[0]);
+                for (size_t chunk = 1; chunk < chunks; chunk++)
+                    for (const auto& [key, count] : partial[chunk]) histogram[key] += count;
+                partial.clear();
+
+                bool hasTransparent = histogram.count(0) > 0;
+                std::vector<Color> colors;
+                colors.reserve(histogram.size());
+                for (const auto& [key, count] : histogram) {
+                    if (key == 0) continue;
+                    Color color;
+                    std::memcpy(color.c, &key, 4);
+                    color.count = count;
+                    colors.push_back(color);
+                }
+                // the map's order isn't stable, the sort keeps the palette the same between runs
+                std::sort(colors.begin(), colors.end(), [](const Color& a, const Color& b) { return pack(a.c) < pack(b.c); });
+
+                int opaqueSlots = target - (hasTransparent ? 1 : 0);
+                std::vector<uint8_t> palette;
+                if (hasTransparent) palette.insert(palette.end(), { 0, 0, 0, 0 });
+                if ((int)colors.size() <= opaqueSlots) {
+                    for (const Color& color : colors) palette.insert(palette.end(), color.c, color.c + 4);
+                }
+                else {
+                    for (const Box& box : medianCut(colors, opaqueSlots)) {
+                        uint64_t sum[4] = {};
+                        for (size_t i = box.begin; i < box.end; i++)
+                            for (int c = 0; c < 4; c++) sum[c] += (uint64_t)colors[i].c[c] * colors[i].count;
+                        for (int c = 0; c < 4; c++) palette.push_back((uint8_t)((sum[c] + box.weight / 2) / box.weight));
+                    }
+                    refine(palette, colors, hasTransparent ? 0 : -1, options.iterations, pool);
+                }
+
+                // translucent entries first, the transparent one stays at index 0
+                std::vector<int> order(palette.size() / 4);
+                for (int i = 0; i < (int)order.size(); i++) order[i] = i;
+                std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return palette[a * 4 + 3] < palette[b * 4 + 3]; });
+                for (int i : order) result.palette.insert(result.palette.end(), palette.begin() + i * 4, palette.begin() + i * 4 + 4);
+
+                NearestColor nearest(result.palette, hasTransparent ? 0 : -1);
+                if (options.dither && (int)colors.size() > opaqueSlots) ditherPixels(pixels, width, height, nearest, result.palette, result, pool);
+                else mapPixels(pixels, width, height, nearest, result, pool);
+                return result;
+            }
+        }
+    }
+}
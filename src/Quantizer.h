@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * Reduces RGBA images to an indexed palette
+        * median cut splits the colors into boxes, a few k-means passes move every palette color
+        * to the center of the colors mapped to it, then every pixel takes its nearest palette color
+        * fully transparent pixels always keep their own palette entry
+        */
+        namespace Quantizer {
+            const int MaxColors = 256;
+
+            struct Options {
+                // palette size, 2 to 256
+                int colors = MaxColors;
+                // Floyd-Steinberg error diffusion
+                bool dither = false;
+                // k-means passes after median cut
+                int iterations = 3;
+            };
+            struct Result {
+                // RGBA entries, the ones with alpha come first so the tRNS chunk stays short
+                std::vector<uint8_t> palette;
+                // one palette index per pixel
+                std::vector<uint8_t> indices;
+
+                int Size() const { return (int)palette.size() / 4; }
+            };
+
+            // the palette is exact when the image has no more colors than requested
+            // the result is the same for any amount of threads
+            Result Quantize(const uint8_t* pixels, int width, int height, const Options& options, ThreadPool& pool);
+        }
+    }
+}
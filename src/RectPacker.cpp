@@ -0,0 +1,204 @@
+#include "RectPacker.h"
+#include <algorithm>
+#include <climits>
+
+// the implementation of stb_rect_pack lives here since this is the only file using it
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../include/stb_rect_pack.h" // For packing the textures within a certain rectangle
+
+namespace QLE {
+    namespace TextureTools {
+        namespace {
+            // Skyline bottom-left from stb_rect_pack
+            class SkylinePacker : public RectPacker
+            {
+            private:
+                stbrp_context context;
+                std::vector<stbrp_node> nodes;
+            public:
+                void Reset(int width, int height) override {
+                    nodes.resize(width);
+                    stbrp_init_target(&context, width, height, nodes.data(), width);
+                }
+                bool Insert(SpriteRect& rect) override {
+                    stbrp_rect packed;
+                    packed.id = rect.id;
+                    packed.w = rect.w;
+                    packed.h = rect.h;
+                    if (!stbrp_pack_rects(&context, &packed, 1)) return false;
+                    rect.x = packed.x;
+                    rect.y = packed.y;
+                    return true;
+                }
+            };
+
+            struct FreeRect {
+                int x, y, w, h;
+            };
+            inline bool isContainedIn(const FreeRect& a, const FreeRect& b) {
+                return a.x >= b.x && a.y >= b.y && a.x + a.w <= b.x + b.w && a.y + a.h <= b.y + b.h;
+            }
+            // length of the shared part of the segments [start1, end1] and [start2, end2]
+            inline int commonInterval(int start1, int end1, int start2, int end2) {
+                if (end1 < start2 || end2 < start1) return 0;
+                return std::min(end1, end2) - std::max(start1, start2);
+            }
+
+            /*
+            * MaxRects keeps every maximal free rectangle of the bin, so a rect can go anywhere it fits
+            * only the free rects split by the last placement are checked for containment, which keeps
+            * the free list small without the usual O(n^2) pruning pass over the whole list
+            */
+            class MaxRectsPacker : public RectPacker
+            {
+            private:
+                PackerType type;
+                int binWidth = 0, binHeight = 0;
+                std::vector<FreeRect> freeRects;
+                // free rects created by the current placement, waiting to be pruned
+                std::vector<FreeRect> newFreeRects;
+                // only needed to score contact points
+                std::vector<FreeRect> usedRects;
+
+                int contactScore(int x, int y, int w, int h) const {
+                    int score = 0;
+                    if (x == 0 || x + w == binWidth) score += h;
+                    if (y == 0 || y + h == binHeight) score += w;
+                    for (const auto& used : usedRects) {
+                        if (used.x == x + w || used.x + used.w == x)
+                            score += commonInterval(used.y, used.y + used.h, y, y + h);
+                        if (used.y == y + h || used.y + used.h == y)
+                            score += commonInterval(used.x, used.x + used.w, x, x + w);
+                    }
+                    return score;
+                }
+                void addNewFreeRect(const FreeRect& rect) {
+                    for (size_t i = 0; i < newFreeRects.size(); i++) {
+                        if (isContainedIn(rect, newFreeRects[i])) return;
+                        if (isContainedIn(newFreeRects[i], rect)) {
+                            newFreeRects[i] = newFreeRects.back();
+                            newFreeRects.pop_back();
+                            i--;
+                        }
+                    }
+                    newFreeRects.push_back(rect);
+                }
+                // returns false if used does not overlap the free rect
+                bool splitFreeRect(const FreeRect& free, const FreeRect& used) {
+                    if (used.x >= free.x + free.w || used.x + used.w <= free.x ||
+                        used.y >= free.y + free.h || used.y + used.h <= free.y)
+                        return false;
+
+                    if (used.x < free.x + free.w && used.x + used.w > free.x) {
+                        // part above the used rect
+                        if (used.y > free.y && used.y < free.y + free.h)
+                            addNewFreeRect({ free.x, free.y, free.w, used.y - free.y });
+                        // part below the used rect
+                        if (used.y + used.h < free.y + free.h)
+                            addNewFreeRect({ free.x, used.y + used.h, free.w, free.y + free.h - (used.y + used.h) });
+                    }
+                    if (used.y < free.y + free.h && used.y + used.h > free.y) {
+                        // part left of the used rect
+                        if (used.x > free.x && used.x < free.x + free.w)
+                            addNewFreeRect({ free.x, free.y, used.x - free.x, free.h });
+                        // part right of the used rect
+                        if (used.x + used.w < free.x + free.w)
+                            addNewFreeRect({ used.x + used.w, free.y, free.x + free.w - (used.x + used.w), free.h });
+                    }
+                    return true;
+                }
+                void place(const FreeRect& used) {
+                    for (size_t i = 0; i < freeRects.size();) {
+                        if (splitFreeRect(freeRects[i], used)) {
+                            freeRects[i] = freeRects.back();
+                            freeRects.pop_back();
+                        }
+                        else i++;
+                    }
+                    // an old free rect can never be inside a new one since the new ones are pieces of
+                    // the rects that were just split, so only the new ones need to be checked
+                    for (const auto& rect : newFreeRects) {
+                        bool contained = false;
+                        for (const auto& old : freeRects) {
+                            if (!isContainedIn(rect, old)) continue;
+                            contained = true;
+                            break;
+                        }
+                        if (!contained) freeRects.push_back(rect);
+                    }
+                    newFreeRects.clear();
+                    if (type == PackerType::MaxRectsContact) usedRects.push_back(used);
+                }
+            public:
+                explicit MaxRectsPacker(PackerType type) : type(type) {}
+
+                void Reset(int width, int height) override {
+                    binWidth = width;
+                    binHeight = height;
+                    freeRects.assign(1, { 0, 0, width, height });
+                    newFreeRects.clear();
+                    usedRects.clear();
+                }
+                bool Insert(SpriteRect& rect) override {
+                    // lower scores are better
+                    int bestScore = INT_MAX, bestSecondary = INT_MAX;
+                    const FreeRect* best = nullptr;
+                    for (const auto& free : freeRects) {
+                        if (free.w < rect.w || free.h < rect.h) continue;
+                        int leftoverX = free.w - rect.w, leftoverY = free.h - rect.h;
+                        int score, secondary;
+                        switch (type) {
+                        case PackerType::MaxRectsArea:
+                            score = free.w * free.h - rect.w * rect.h;
+                            secondary = std::min(leftoverX, leftoverY);
+                            break;
+                        case PackerType::MaxRectsContact:
+                            score = -contactScore(free.x, free.y, rect.w, rect.h);
+                            secondary = 0;
+                            break;
+                        default:
+                            score = std::min(leftoverX, leftoverY);
+                            secondary = std::max(leftoverX, leftoverY);
+                            break;
+                        }
+                        if (score < bestScore || (score == bestScore && secondary < bestSecondary)) {
+                            bestScore = score;
+                            bestSecondary = secondary;
+                            best = &free;
+                        }
+                    }
+                    if (!best) return false;
+
+                    rect.x = best->x;
+                    rect.y = best->y;
+                    place({ rect.x, rect.y, rect.w, rect.h });
+                    return true;
+                }
+            };
+        }
+
+        std::unique_ptr<RectPacker> RectPacker::Create(PackerType type)
+        {
+            if (type == PackerType::Skyline) return std::make_unique<SkylinePacker>();
+            return std::make_unique<MaxRectsPacker>(type);
+        }
+        const char* RectPacker::Name(PackerType type)
+        {
+            switch (type) {
+            case PackerType::MaxRects: return "maxrects";
+            case PackerType::MaxRectsArea: return "maxrects-area";
+            case PackerType::MaxRectsContact: return "maxrects-contact";
+            default: return "skyline";
+            }
+        }
+        bool RectPacker::Parse(const std::string& name, PackerType& type)
+        {
+            for (PackerType candidate : { PackerType::Skyline, PackerType::MaxRects, PackerType::MaxRectsArea, PackerType::MaxRectsContact }) {
+                if (name != Name(candidate)) continue;
+                type = candidate;
+                return true;
+            }
+            return false;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        // Placement of an image within a spritesheet. id is the index of the image it belongs to
+        struct SpriteRect {
+            int id = 0;
+            int x = 0, y = 0, w = 0, h = 0;
+        };
+        // Planned content and final size of a single spritesheet
+        struct SheetLayout {
+            int width = 0, height = 0;
+            std::vector<SpriteRect> rects;
+        };
+        // Algorithm used to place the rects inside a sheet
+        enum class PackerType {
+            // stb_rect_pack's skyline bottom-left
+            Skyline,
+            // MaxRects, best short side fit
+            MaxRects,
+            // MaxRects, best area fit
+            MaxRectsArea,
+            // MaxRects, contact point. tightest of the three but slower on big sheets
+            MaxRectsContact
+        };
+
+        // Places rects one by one inside a single bin
+        class RectPacker
+        {
+        public:
+            virtual ~RectPacker() = default;
+            // empties the bin and resizes it
+            virtual void Reset(int width, int height) = 0;
+            // sets rect.x and rect.y and returns true if the rect fits in the bin
+            virtual bool Insert(SpriteRect& rect) = 0;
+
+            static std::unique_ptr<RectPacker> Create(PackerType type);
+            static const char* Name(PackerType type);
+            // returns false if the name is unknown
+            static bool Parse(const std::string& name, PackerType& type);
+        };
+    }
+}
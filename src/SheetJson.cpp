@@ -0,0 +1,115 @@
+#include "SheetJson.h"
+#include "../include/json.hpp"
+#include <fstream>
+#include <stdexcept>
+
+namespace QLE {
+    namespace TextureTools {
+        namespace {
+            /*
+            * follows where the parser is in the sheet and writes each value into its field
+            * depth 1 is the sheet, 2 the "sprites" array, 3 a sprite and 4 an object in it like "position"
+            */
+            class SheetJsonHandler : public nlohmann::json_sax<nlohmann::json> {
+            private:
+                SheetJson& sheet;
+                int depth = 0;
+                bool inSprites = false;
+                std::string rootKey, spriteKey;
+                // the field the next number goes to, set by the key before it
+                int* intField = nullptr;
+                float* floatField = nullptr;
+
+                bool setNumber(double value) {
+                    if (intField) *intField = (int)value;
+                    else if (floatField) *floatField = (float)value;
+                    return true;
+                }
+                void findField(const std::string& member) {
+                    SheetJsonSprite& sprite = sheet.sprites.back();
+                    const bool isX = member == "x", isY = member == "y";
+                    const bool isWidth = member == "width", isHeight = member == "height";
+                    if (spriteKey == "position") intField = isX ? &sprite.x : isY ? &sprite.y : nullptr;
+                    else if (spriteKey == "size") intField = isWidth ? &sprite.width : isHeight ? &sprite.height : nullptr;
+                    else if (spriteKey == "pivot") floatField = isX ? &sprite.pivotX : isY ? &sprite.pivotY : nullptr;
+                    else if (spriteKey == "sourceSize") intField = isWidth ? &sprite.sourceWidth : isHeight ? &sprite.sourceHeight : nullptr;
+                    else if (spriteKey == "spriteSourceOffset") intField = isX ? &sprite.offsetX : isY ? &sprite.offsetY : nullptr;
+                }
+            public:
+                std::string error;
+                explicit SheetJsonHandler(SheetJson& sheet) : sheet(sheet) {}
+
+                bool null() override { return true; }
+                bool boolean(bool) override { return true; }
+                bool number_integer(number_integer_t value) override { return setNumber((double)value); }
+                bool number_unsigned(number_unsigned_t value) override { return setNumber((double)value); }
+                bool number_float(number_float_t value, const string_t&) override { return setNumber(value); }
+                bool binary(binary_t&) override { return true; }
+                bool string(string_t& value) override {
+                    if (depth == 1 && rootKey == "texture") sheet.texture = std::move(value);
+                    else if (depth == 1 && rootKey == "group") sheet.group = std::move(value);
+                    else if (inSprites && depth == 3 && spriteKey == "name") sheet.sprites.back().name = std::move(value);
+                    else if (inSprites && depth == 3 && spriteKey == "extension") sheet.sprites.back().extension = std::move(value);
+                    return true;
+                }
+                bool key(string_t& value) override {
+                    intField = nullptr;
+                    floatField = nullptr;
+                    if (depth == 1) rootKey = std::move(value);
+                    else if (inSprites && depth == 3) spriteKey = std::move(value);
+                    else if (inSprites && depth == 4) findField(value);
+                    return true;
+                }
+                bool start_object(std::size_t) override {
+                    depth++;
+                    if (inSprites && depth == 3) sheet.sprites.emplace_back();
+                    else if (inSprites && depth == 4 && spriteKey == "sourceSize") sheet.sprites.back().trimmed = true;
+                    return true;
+                }
+                bool end_object() override {
+                    depth--;
+                    intField = nullptr;
+                    floatField = nullptr;
+                    return true;
+                }
+                bool start_array(std::size_t) override {
+                    depth++;
+                    if (depth == 2 && rootKey == "sprites") inSprites = true;
+                    return true;
+                }
+                bool end_array() override {
+                    if (depth == 2) inSprites = false;
+                    depth--;
+                    return true;
+                }
+                bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) override {
+                    error = e.what();
+                    return false;
+                }
+            };
+        }
+
+        SheetJson SheetJson::Parse(std::string_view text) {
+            SheetJson sheet;
+            SheetJsonHandler handler(sheet);
+            if (!nlohmann::json::sax_parse(text, &handler)) throw std::runtime_error("Failed to parse sheet JSON: " + handler.error);
+            return sheet;
+        }
+        std::string SheetJson::ReadText(const std::filesystem::path& path) {
+            std::ifstream input(path, std::ios::binary | std::ios::ate);
+            if (!input.is_open()) throw std::runtime_error("Failed to open JSON file: " + path.string());
+            // parsing from memory is much faster than from the stream
+            std::string text((size_t)input.tellg(), '\0');
+            input.seekg(0);
+            if (!input.read(text.data(), (std::streamsize)text.size())) throw std::runtime_error("Failed to read JSON file: " + path.string());
+            return text;
+        }
+        SheetJson SheetJson::Read(const std::filesystem::path& path) {
+            const std::string text = ReadText(path);
+            try { return Parse(text); }
+            catch (const std::runtime_error& e) {
+                throw std::runtime_error(std::string(e.what()) + " (" + path.string() + ")");
+            }
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        // one entry of "sprites" in a sheet .json
+        struct SheetJsonSprite {
+            std::string name;
+            std::string extension;
+            int x = 0, y = 0, width = 0, height = 0;
+            float pivotX = .5f, pivotY = .5f;
+            // sourceSize and spriteSourceOffset are only written with -trim
+            bool trimmed = false;
+            int sourceWidth = 0, sourceHeight = 0;
+            int offsetX = 0, offsetY = 0;
+        };
+        /*
+        * The sprites of a sheet .json, read with a SAX parser straight into the fields
+        * no DOM is built, so a sheet with many sprites reads in a fraction of the time and memory
+        * throws std::runtime_error if the file can't be read or isn't valid JSON
+        */
+        struct SheetJson {
+            std::string texture;
+            std::string group;
+            std::vector<SheetJsonSprite> sprites;
+
+            static SheetJson Parse(std::string_view text);
+            static SheetJson Read(const std::filesystem::path& path);
+            // the whole file, for callers that parse it more than once
+            static std::string ReadText(const std::filesystem::path& path);
+        };
+    }
+}
@@ -4,17 +4,39 @@
 
 // don't include stb libraries into the header files. it will cause LNK2005 errors
 // also, if you decide to use stb libraries as part of your code, be sure to set these defines once only
-#define STB_RECT_PACK_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "../include/stb_image.h" // For reading images
 #include "../include/stb_image_write.h"  // For saving the output image
-#include "../include/stb_rect_pack.h" // For packing the textures within a certain rectangle
 
 #include "../include/json.hpp" // For exporting/importing json
+#include "Hash.h" // For finding duplicate images
+#include "Blit.h" // For copying pixels between images and sheets
+#include "PngWriter.h" // For compressing sheets on several threads
+#include "Quantizer.h" // For reducing sheets to a palette
+#include "Manifest.h" // For incremental builds
+#include "BuildCache.h" // For reusing builds between machines
+#include "DirectoryWatcher.h" // For rebuilding on changes
+#include "PackerServer.h" // For the -server and -client modes
+#include "BuildStats.h" // For -stats
+#include "Trace.h" // For -trace
+#include "BinaryMetadata.h" // For -meta=bin
+#include "FileUtils.h" // For replacing outputs that may be linked into the build cache
+#include "SheetJson.h" // For reading sheet .json when unpacking and setting pivots
+#include <memory>
 #include <fstream> // For reading .json
 #include <sstream> // For separating options from a single string
+#include <iomanip> // For printing ratios
+#include <cstring> // For moving pixel rows
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <semaphore> // For capping the sheets in flight
+#include <thread>
+#include <chrono> // For timing the watch rebuilds
+#include "BlockingQueue.h" // For handing sheets between the pipeline stages
 
 namespace fs = std::filesystem;
 using std::cout;
@@ -26,12 +48,19 @@ using std::endl;
 #else
 #define TP_COMPRESSION_TOOL "pngquant";
 #endif
+// set by CMake, part of the build cache key
+#ifndef TEXTUREPACKER_VERSION
+#define TEXTUREPACKER_VERSION "dev"
+#endif
 
 namespace QLE {
     namespace TextureTools {
-        TexturePacker::TexturePacker()
+        TexturePacker::TexturePacker() : TexturePacker(true)
         {
-            showBanner();
+        }
+        TexturePacker::TexturePacker(bool banner)
+        {
+            if (banner) showBanner();
             compressionTool = TP_COMPRESSION_TOOL;
         }
 #pragma region General
@@ -77,8 +106,36 @@ namespace QLE {
             cout << "\t-size=<spritesheet_size>    | Defaults to " << DEFAULT_SHEET_SIZE << endl;
             cout << "\t-group=<spritesheet_name>   | Defaults to sheet" << endl;
             cout << "\t-pivot=<pivot_directory>    | folder path containing .json to override the pivot points of sprites" << endl;
-            cout << "\t-compress                   | Compresses the output folder using \""<< compressionTool <<"\"" << endl;
-            cout << "\t-nonrecursive               | Uses the input folder path only" << endl << endl;
+            cout << "\t-compress                   | Reduces the sheets to an 8 bit palette before saving them" << endl;
+            cout << "\t-compress=pngquant          | Compresses the saved sheets using \""<< compressionTool <<"\" instead" << endl;
+            cout << "\t-colors=<2-256>             | Palette size used by -compress. Defaults to " << Quantizer::MaxColors << endl;
+            cout << "\t-dither                     | Spreads the color error of -compress over the neighbouring pixels" << endl;
+            cout << "\t-nonrecursive               | Uses the input folder path only" << endl;
+            cout << "\t-threads=<count>            | Threads used to decode images. Defaults to 0 (all hardware threads)" << endl;
+            cout << "\t-heuristic=<name>           | Sorts images before packing: none, height, area, maxside, perimeter, best. Defaults to none" << endl;
+            cout << "\t-packer=<name>              | Placement algorithm: skyline, maxrects, maxrects-area, maxrects-contact. Defaults to skyline" << endl;
+            cout << "\t-multibin                   | Places images across all sheets at once to use fewer and smaller sheets" << endl;
+            cout << "\t-meta=<json|bin|both>       | Describes the sprites with a .json per sheet, a .bin per group that can be read in place, or both. Defaults to json" << endl;
+            cout << "\t-trim                       | Removes the transparent borders of the images. Unpacking restores them" << endl;
+            cout << "\t-dedup                      | Packs identical images once. Every copy is still listed in the .json" << endl;
+            cout << "\t-incremental                | Keeps a manifest next to the sheets and only rebuilds the sheets whose images changed" << endl;
+            cout << "\t-cache-dir=<cache_directory>| Reuses finished builds with the same images and settings. Can be shared between machines" << endl;
+            cout << "\t-cache-size=<megabytes>     | Size of the cache before the least recently used builds are removed. Defaults to " << DEFAULT_CACHE_SIZE_MB << endl;
+            cout << "\t-cache-link                 | Hard links the .png files out of the cache instead of copying them" << endl;
+            cout << "\t-stats                      | Prints the time spent in every stage of the build" << endl;
+            cout << "\t-stats=<file.json>          | Same as -stats and saves the numbers to a .json" << endl;
+            cout << "\t-trace=<file.json>          | Saves what every thread did during the build. Open it in chrome://tracing or ui.perfetto.dev" << endl;
+            cout << "\t-watch                      | Keeps running and rebuilds the sheets whose images changed. Implies -incremental" << endl;
+            cout << "\t-watch-debounce=<ms>        | Quiet time after a change before rebuilding. Defaults to " << DEFAULT_WATCH_DEBOUNCE_MS << endl;
+            cout << "\t-project=<project_file>     | Packs every group of a .json project file in one go. Replaces -p, -i and -o" << endl;
+            cout << "\t-server=<socket_path>       | Runs until stopped, packing the jobs sent with -client. Keeps the decoded images between jobs" << endl;
+            cout << "\t-image-cache=<megabytes>    | Decoded images a -server keeps before the least recently used are dropped. 0 keeps all. Defaults to " << DEFAULT_IMAGE_CACHE_MB << endl;
+            cout << "\t-client=<socket_path>       | Sends the other options to the server as a job. -stop and -status manage the server" << endl;
+            cout << "\t-sheets-in-flight=<count>   | Sheets composed, encoded and written at the same time. Defaults to 3" << endl;
+            cout << "\t-png-threads=<count>        | Threads compressing each sheet. Defaults to 1" << endl;
+            cout << "\t-png-level=<0-9>            | Compression level of the sheets. Defaults to " << PngWriter::DefaultLevel << endl;
+            cout << "\t-png-filter=<name>          | Row filter: none, sub, up, avg, paeth, adaptive. Defaults to adaptive" << endl;
+            cout << "\t-png-fast                   | Fastest compression for iteration builds (-png-level=1 -png-filter=up)" << endl << endl;
             cout << "  [ Examples ]" << endl;
             cout << "TexturePacker.exe -p -i=\"C:\\input_folder\" -o=\"C:\\output_folder\"" << endl;
             cout << "TexturePacker.exe -p -i=\"C:\\input_folder\" -o=\"C:\\output_folder\" -size=2048 -group=\"sheet\"" << endl;
@@ -91,14 +148,38 @@ namespace QLE {
         ImageData TexturePacker::loadImage(const fs::path& imagePath) {
             ImageData img;
             img.path = imagePath.string();
+            Trace::Span span(trace.get(), "loadImage", "decode", img.path);
+            // images decoded by an earlier build are copied out of the cache while their file is unchanged
+            // the stamp is read before decoding, so a file written meanwhile is decoded again next time
+            FileStamp stamp;
+            if (imageCache) {
+                stamp = FileStamp::Read(imagePath);
+                if (auto cached = imageCache->Find(img.path, stamp)) {
+                    img.width = img.sourceWidth = cached->width;
+                    img.height = img.sourceHeight = cached->height;
+                    img.channels = cached->channels;
+                    // freed with stbi_image_free like any other image
+                    img.data = (uint8_t*)STBI_MALLOC(cached->pixels.size());
+                    if (!img.data) throw std::runtime_error("Out of memory loading image: " + imagePath.string());
+                    std::memcpy(img.data, cached->pixels.data(), cached->pixels.size());
+                    return img;
+                }
+            }
             img.data = stbi_load(imagePath.string().c_str(), &img.width, &img.height, &img.channels, STBI_rgb_alpha); // Force 4 channels (RGBA)
             if (!img.data) {
                 throw std::runtime_error("Failed to load image: " + imagePath.string());
             }
+            img.sourceWidth = img.width;
+            img.sourceHeight = img.height;
             bool isOpaque = img.channels == 3;
-            if (isOpaque) {
-                for (int i = 0; i < img.width * img.height; ++i)
-                    img.data[i * STBI_rgb_alpha + 3] = 255; // Set alpha channel to 255
+            if (isOpaque) Blit::FillAlpha(img.data, (size_t)img.width * img.height, 255); // Set alpha channel to 255
+            if (imageCache) {
+                auto decoded = std::make_shared<DecodedImage>();
+                decoded->width = img.width;
+                decoded->height = img.height;
+                decoded->channels = img.channels;
+                decoded->pixels.assign(img.data, img.data + (size_t)img.width * img.height * STBI_rgb_alpha);
+                imageCache->Store(img.path, stamp, std::move(decoded));
             }
             return img;
         }
@@ -108,15 +189,114 @@ namespace QLE {
             while (power < x) power *= 2;
             return power;
         }
+        ImageData TexturePacker::probeImage(const fs::path& imagePath) {
+            ImageData img;
+            img.path = imagePath.string();
+            Trace::Span span(trace.get(), "probeImage", "scan", img.path);
+            if (imageCache) {
+                if (auto cached = imageCache->Find(img.path, FileStamp::Read(imagePath))) {
+                    img.width = img.sourceWidth = cached->width;
+                    img.height = img.sourceHeight = cached->height;
+                    img.channels = cached->channels;
+                    return img;
+                }
+            }
+            // only reads the header. the pixels are decoded once the image has a place in a sheet
+            if (!stbi_info(imagePath.string().c_str(), &img.width, &img.height, &img.channels)) {
+                throw std::runtime_error("Failed to read image info: " + imagePath.string());
+            }
+            img.sourceWidth = img.width;
+            img.sourceHeight = img.height;
+            return img;
+        }
+        ImageData TexturePacker::loadImage(const AtlasImage& source) {
+            ImageData img;
+            img.path = source.name;
+            if (source.pixels) {
+                if (source.width <= 0 || source.height <= 0) throw std::runtime_error("Invalid image size: " + source.name);
+                const size_t bytes = (size_t)source.width * source.height * STBI_rgb_alpha;
+                // freed with stbi_image_free like a decoded image
+                img.data = (uint8_t*)STBI_MALLOC(bytes);
+                if (!img.data) throw std::runtime_error("Out of memory loading image: " + source.name);
+                std::memcpy(img.data, source.pixels, bytes);
+                img.width = source.width;
+                img.height = source.height;
+                img.channels = STBI_rgb_alpha;
+            }
+            else {
+                img.data = stbi_load_from_memory(source.encoded.data(), (int)source.encoded.size(), &img.width, &img.height, &img.channels, STBI_rgb_alpha);
+                if (!img.data) throw std::runtime_error("Failed to decode image: " + source.name);
+                if (img.channels == 3) Blit::FillAlpha(img.data, (size_t)img.width * img.height, 255);
+            }
+            img.sourceWidth = img.width;
+            img.sourceHeight = img.height;
+            return img;
+        }
+        // crops the fully transparent borders of a decoded image in place
+        static void trimImage(ImageData& img) {
+            const int stride = img.width * STBI_rgb_alpha;
+
+            int left, top;
+            if (!Blit::FindAlphaBounds(img.data, img.width, img.height, left, top, img.width, img.height)) {
+                // nothing visible. keep a single transparent pixel so the sprite still exists
+                img.width = img.height = 1;
+                img.data[3] = 0;
+                return;
+            }
+            img.offsetX = left;
+            img.offsetY = top;
+            if (!img.IsTrimmed()) return;
+
+            // move the visible rows to the front of the buffer. the destination never overtakes the source
+            const int trimmedStride = img.width * STBI_rgb_alpha;
+            for (int y = 0; y < img.height; y++)
+                std::memmove(img.data + y * trimmedStride, img.data + (top + y) * stride + left * STBI_rgb_alpha, trimmedStride);
+            // stb_image allocates with malloc, so the buffer can shrink in place
+            if (uint8_t* shrunk = (uint8_t*)std::realloc(img.data, (size_t)trimmedStride * img.height)) img.data = shrunk;
+        }
+        ImageData TexturePacker::loadTrimmedImage(const fs::path& imagePath) {
+            ImageData img = loadImage(imagePath);
+            trimImage(img);
+            return img;
+        }
+        // the size is part of the seed so images with the same bytes but another shape don't match
+        static uint64_t pixelHash(const ImageData& img) {
+            return Hash64(img.data, (size_t)img.width * img.height * STBI_rgb_alpha, ((uint64_t)img.width << 32) | (uint32_t)img.height);
+        }
+        // frees the images still decoded when a build stops early
+        static void freeImages(vector<ImageData>& images) {
+            for (auto& img : images) {
+                stbi_image_free(img.data);
+                img.data = nullptr;
+            }
+        }
         // Function to export sprite information to a JSON file
-        void exportSpriteInfoToJson(const std::vector<stbrp_rect>& rects, const std::vector<ImageData>& images,
+        // returns the size of the written file
+        size_t exportSpriteInfoToJson(const SheetLayout& layout, const std::vector<ImageData>& images, const vector<vector<ImageData>>& aliases,
             const fs::path& outputTextureFileName, const PackingSettings settings) {
             nlohmann::json jsonOutput;
             jsonOutput["texture"] = outputTextureFileName.string();
             jsonOutput["group"] = settings.Group;
+            // how the .png was compressed, so a build can be told apart from a shipping one
+            jsonOutput["png"] = {
+                {"encoder", settings.UsesPngWriter() ? "texturepacker" : "stb_image_write"},
+                {"level", settings.pngLevel},
+                {"filter", PngWriter::FilterName(settings.pngFilter)}
+            };
+            if (settings.useCompression) {
+                jsonOutput["png"]["colors"] = settings.paletteColors;
+                jsonOutput["png"]["dither"] = settings.dither;
+            }
 
-            for (const auto& rect : rects) {
-                const ImageData& img = images[rect.id];
+            // duplicates get their own entry pointing at the rect of the image they're a copy of
+            vector<std::pair<const SpriteRect*, const ImageData*>> sprites;
+            for (const auto& rect : layout.rects) {
+                sprites.push_back({ &rect, &images[rect.id] });
+                for (const auto& alias : aliases[rect.id]) sprites.push_back({ &rect, &alias });
+            }
+            for (const auto& [spriteRect, spriteImage] : sprites) {
+                const SpriteRect& rect = *spriteRect;
+                const ImageData& img = *spriteImage;
 
                 // Get file name without extension
                 std::string fileName = fs::path(img.path).stem().string();
@@ -128,6 +308,10 @@ namespace QLE {
                 spriteInfo["position"] = { {"x", rect.x}, {"y", rect.y} };
                 spriteInfo["pivot"] = { {"x", .5f}, {"y", .5f} };
                 spriteInfo["size"] = { {"width", rect.w}, {"height", rect.h} };
+                if (settings.trim) {
+                    spriteInfo["sourceSize"] = { {"width", img.sourceWidth}, {"height", img.sourceHeight} };
+                    spriteInfo["spriteSourceOffset"] = { {"x", img.offsetX}, {"y", img.offsetY} };
+                }
 
                 jsonOutput["sprites"].push_back(spriteInfo);
             }
@@ -139,94 +323,817 @@ namespace QLE {
                 throw std::runtime_error("Failed to open JSON file for writing: " + outputJsonPath.string());
             }
 
-            outputFile << jsonOutput.dump(4);  // Pretty print with indentation
+            const std::string text = jsonOutput.dump(4);  // Pretty print with indentation
+            outputFile << text;
             outputFile.close();
             cout << "[Info] JSON file saved to " << outputJsonPath << endl;
+            return text.size();
         }
-        // Pack images into texture sheets and handle multiple sheets if needed
-        void TexturePacker::packImagesIntoSheets(const std::vector<fs::path>& imagePaths, const fs::path& outputDir, const std::string& Group) {
-            int textureIndex = 0;
-            int start = 0;
+        static const char* sortHeuristicName(SortHeuristic heuristic) {
+            switch (heuristic) {
+            case SortHeuristic::Height: return "height";
+            case SortHeuristic::Area: return "area";
+            case SortHeuristic::MaxSide: return "maxside";
+            case SortHeuristic::Perimeter: return "perimeter";
+            case SortHeuristic::Best: return "best";
+            default: return "none";
+            }
+        }
+        static bool parseSortHeuristic(const string& name, SortHeuristic& heuristic) {
+            for (SortHeuristic candidate : { SortHeuristic::None, SortHeuristic::Height, SortHeuristic::Area,
+                SortHeuristic::MaxSide, SortHeuristic::Perimeter, SortHeuristic::Best }) {
+                if (name != sortHeuristicName(candidate)) continue;
+                heuristic = candidate;
+                return true;
+            }
+            return false;
+        }
+        // used area of the sheets against their total area. 1.0 means no texel is wasted
+        static double fillRatio(const vector<SheetLayout>& layouts) {
+            double usedArea = 0, sheetArea = 0;
+            for (const auto& layout : layouts) {
+                sheetArea += (double)layout.width * layout.height;
+                for (const auto& rect : layout.rects) usedArea += (double)rect.w * rect.h;
+            }
+            return sheetArea > 0 ? usedArea / sheetArea : 0;
+        }
+        void TexturePacker::fitSheetSize(SheetLayout& layout) {
+            // Determine the actual minimum required texture size based on the packed rectangles
+            int required_width = 0, required_height = 0;
+            for (const auto& rect : layout.rects) {
+                required_width = std::max(required_width, rect.x + rect.w);
+                required_height = std::max(required_height, rect.y + rect.h);
+            }
 
-            // Ensure output directory exists
-            if (!fs::exists(outputDir)) fs::create_directories(outputDir);
+            // Adjust the size to the nearest power of two
+            layout.width = nextPowerOfTwo(required_width);
+            layout.height = nextPowerOfTwo(required_height);
+        }
+        vector<SheetLayout> TexturePacker::planSheetsInOrder(const vector<ImageData>& images) {
+            vector<SheetLayout> layouts;
+            size_t start = 0;
+
+            std::unique_ptr<RectPacker> packer = RectPacker::Create(settings.packer);
 
-            while (start < imagePaths.size()) {
-                vector<ImageData> images;
-                vector<stbrp_rect> rects;
-                int current_count = 0;
+            while (start < images.size()) {
+                Trace::Span span(trace.get(), "pack sheet", "plan", std::to_string(layouts.size()));
+                SheetLayout layout;
 
                 // Initialize packing context with max possible size
-                int sheet_width = settings.MaxTextureSize, sheet_height = settings.MaxTextureSize;
-                stbrp_context context;
-                vector<stbrp_node> nodes(sheet_width);
-                stbrp_init_target(&context, sheet_width, sheet_height, nodes.data(), sheet_width);
+                packer->Reset(settings.MaxTextureSize, settings.MaxTextureSize);
 
                 // Try packing images into this sheet
-                for (int i = start,spriteIndex = 0; i < imagePaths.size(); ++i,spriteIndex++) {
-                    images.push_back(loadImage(imagePaths[i]));
+                for (size_t i = start; i < images.size(); ++i) {
+                    SpriteRect rect;
+                    rect.w = images[i].width;
+                    rect.h = images[i].height;
+                    rect.id = (int)i;
+
+                    if (packer->Insert(rect)) layout.rects.push_back(rect);
+                    else break;
+                }
+                if (layout.rects.empty())
+                    throw std::runtime_error("Image is bigger than the spritesheet size (" + std::to_string(settings.MaxTextureSize) + "): " + images[start].path);
 
-                    stbrp_rect rect;
-                    rect.w = images[spriteIndex].width;
-                    rect.h = images[spriteIndex].height;
-                    rect.id = spriteIndex;
+                fitSheetSize(layout);
+
+                // Move to the next batch of images
+                start += layout.rects.size();
+                layouts.push_back(std::move(layout));
+            }
+            return layouts;
+        }
+        // biggest first. ties fall back to the other side and then to the directory order so the result is stable
+        static void sortByHeuristic(vector<int>& ids, const vector<ImageData>& images, SortHeuristic heuristic) {
+            auto primaryKey = [&](const ImageData& img) -> long long {
+                switch (heuristic) {
+                case SortHeuristic::Area: return (long long)img.width * img.height;
+                case SortHeuristic::MaxSide: return std::max(img.width, img.height);
+                case SortHeuristic::Perimeter: return 2LL * (img.width + img.height);
+                default: return img.height;
+                }
+            };
+            std::stable_sort(ids.begin(), ids.end(), [&](int a, int b) {
+                long long keyA = primaryKey(images[a]), keyB = primaryKey(images[b]);
+                if (keyA != keyB) return keyA > keyB;
+                int sideA = std::min(images[a].width, images[a].height), sideB = std::min(images[b].width, images[b].height);
+                return sideA > sideB;
+            });
+        }
+        // packs the ids in order into a width x height bin. returns the ones that don't fit
+        static vector<int> packIntoBin(RectPacker& packer, int width, int height, const vector<int>& ids,
+            const vector<ImageData>& images, vector<SpriteRect>& placed) {
+            vector<int> leftovers;
+            packer.Reset(width, height);
+            for (int id : ids) {
+                SpriteRect rect;
+                rect.w = images[id].width;
+                rect.h = images[id].height;
+                rect.id = id;
+                if (packer.Insert(rect)) placed.push_back(rect);
+                else leftovers.push_back(id);
+            }
+            return leftovers;
+        }
+        vector<SheetLayout> TexturePacker::planSheetsSorted(const vector<ImageData>& images, SortHeuristic heuristic) {
+            vector<int> remaining(images.size());
+            for (size_t i = 0; i < images.size(); i++) remaining[i] = (int)i;
+            sortByHeuristic(remaining, images, heuristic);
+
+            vector<SheetLayout> layouts;
+            std::unique_ptr<RectPacker> packer = RectPacker::Create(settings.packer);
+            while (!remaining.empty()) {
+                Trace::Span span(trace.get(), "pack sheet", "plan", std::to_string(layouts.size()));
+                SheetLayout layout;
+
+                // images that don't fit wait for the next sheet instead of closing this one
+                vector<int> leftovers = packIntoBin(*packer, settings.MaxTextureSize, settings.MaxTextureSize, remaining, images, layout.rects);
+                if (layout.rects.empty())
+                    throw std::runtime_error("Image is bigger than the spritesheet size (" + std::to_string(settings.MaxTextureSize) + "): " + images[remaining.front()].path);
+
+                fitSheetSize(layout);
+                layouts.push_back(std::move(layout));
+                remaining = std::move(leftovers);
+            }
+            return layouts;
+        }
+        vector<SheetLayout> TexturePacker::planSheetsGlobal(const vector<ImageData>& images, SortHeuristic heuristic) {
+            // first fit decreasing needs a decreasing order, directory order is meaningless here
+            if (heuristic == SortHeuristic::None) heuristic = SortHeuristic::Area;
+            vector<int> order(images.size());
+            for (size_t i = 0; i < images.size(); i++) order[i] = (int)i;
+            sortByHeuristic(order, images, heuristic);
+
+            // every sheet stays open, each image goes into the first one that still has room for it
+            vector<std::unique_ptr<RectPacker>> bins;
+            vector<SheetLayout> layouts;
+            for (int id : order) {
+                SpriteRect rect;
+                rect.w = images[id].width;
+                rect.h = images[id].height;
+                rect.id = id;
+                size_t bin = 0;
+                while (bin < bins.size() && !bins[bin]->Insert(rect)) bin++;
+                if (bin == bins.size()) {
+                    bins.push_back(RectPacker::Create(settings.packer));
+                    bins.back()->Reset(settings.MaxTextureSize, settings.MaxTextureSize);
+                    layouts.emplace_back();
+                    if (!bins.back()->Insert(rect))
+                        throw std::runtime_error("Image is bigger than the spritesheet size (" + std::to_string(settings.MaxTextureSize) + "): " + images[id].path);
+                }
+                layouts[bin].rects.push_back(rect);
+            }
+            bins.clear();
+            for (auto& layout : layouts) fitSheetSize(layout);
+
+            std::unique_ptr<RectPacker> packer = RectPacker::Create(settings.packer);
+            auto texels = [](const SheetLayout& layout) { return (long long)layout.width * layout.height; };
+            auto idsOf = [](const SheetLayout& layout) {
+                vector<int> ids;
+                for (const auto& rect : layout.rects) ids.push_back(rect.id);
+                return ids;
+            };
+
+            // Rebalance: the last sheet holds whatever didn't fit anywhere else and is usually almost empty.
+            // Repack it together with each of the other sheets and keep the result whenever it takes fewer texels
+            for (size_t other = 0; other + 1 < layouts.size(); other++) {
+                Trace::Span span(trace.get(), "rebalance", "plan", std::to_string(other));
+                SheetLayout& last = layouts.back();
+                vector<int> ids = idsOf(layouts[other]), lastIds = idsOf(last);
+                ids.insert(ids.end(), lastIds.begin(), lastIds.end());
+                sortByHeuristic(ids, images, heuristic);
+
+                SheetLayout merged, rest;
+                vector<int> leftovers = packIntoBin(*packer, settings.MaxTextureSize, settings.MaxTextureSize, ids, images, merged.rects);
+                if (!packIntoBin(*packer, settings.MaxTextureSize, settings.MaxTextureSize, leftovers, images, rest.rects).empty()) continue;
+                fitSheetSize(merged);
+                if (!rest.rects.empty()) fitSheetSize(rest);
+                if (texels(merged) + texels(rest) >= texels(layouts[other]) + texels(last)) continue;
+
+                layouts[other] = std::move(merged);
+                if (rest.rects.empty()) {
+                    layouts.pop_back();
+                    other = (size_t)-1; // one sheet less, start over with the new last sheet
+                }
+                else last = std::move(rest);
+            }
 
-                    if (stbrp_pack_rects(&context, &rect, 1)) {
-                        rects.push_back(rect);
-                        current_count++;
+            // Shrink: halve a side of each sheet for as long as all its images still fit
+            for (auto& layout : layouts) {
+                Trace::Span span(trace.get(), "shrink", "plan");
+                vector<int> ids = idsOf(layout);
+                sortByHeuristic(ids, images, heuristic);
+                bool shrunk = true;
+                while (shrunk) {
+                    shrunk = false;
+                    // try the longest side first
+                    int sides[2][2] = { { layout.width / 2, layout.height }, { layout.width, layout.height / 2 } };
+                    if (layout.height > layout.width) std::swap(sides[0], sides[1]);
+                    for (auto& side : sides) {
+                        SheetLayout smaller;
+                        if (side[0] == 0 || side[1] == 0) continue;
+                        if (!packIntoBin(*packer, side[0], side[1], ids, images, smaller.rects).empty()) continue;
+                        fitSheetSize(smaller);
+                        layout = std::move(smaller);
+                        shrunk = true;
+                        break;
                     }
-                    else break;
                 }
+            }
+            return layouts;
+        }
+        void TexturePacker::removeDuplicateImages(vector<ImageData>& images, vector<vector<ImageData>>& aliases) {
+            vector<ImageData> uniqueImages;
+            // hash to the unique images having it. more than one only on a hash collision
+            std::unordered_map<uint64_t, vector<int>> byHash;
+            int duplicates = 0;
+            for (auto& img : images) {
+                int original = -1;
+                for (int candidate : byHash[img.hash]) {
+                    const ImageData& other = uniqueImages[candidate];
+                    if (other.width != img.width || other.height != img.height) continue;
+                    if (std::memcmp(other.data, img.data, (size_t)img.width * img.height * STBI_rgb_alpha) != 0) continue;
+                    original = candidate;
+                    break;
+                }
+                if (original < 0) {
+                    byHash[img.hash].push_back((int)uniqueImages.size());
+                    uniqueImages.push_back(img);
+                    aliases.emplace_back();
+                    continue;
+                }
+                stbi_image_free(img.data);
+                img.data = nullptr;
+                aliases[original].push_back(img);
+                duplicates++;
+            }
+            images = std::move(uniqueImages);
+            if (duplicates > 0) cout << "[Info] Found " << duplicates << " duplicate image(s). They share the rect of their original" << endl;
+        }
+        vector<SheetLayout> TexturePacker::planSheets(const vector<ImageData>& images) {
+            SortHeuristic chosen = settings.heuristic;
+            vector<SheetLayout> layouts;
+            auto plan = [&](SortHeuristic heuristic) {
+                Trace::Span span(trace.get(), "plan", "plan", sortHeuristicName(heuristic));
+                if (settings.multiBin) return planSheetsGlobal(images, heuristic);
+                if (heuristic == SortHeuristic::None) return planSheetsInOrder(images);
+                return planSheetsSorted(images, heuristic);
+            };
+            if (settings.heuristic != SortHeuristic::Best) layouts = plan(settings.heuristic);
+            else {
+                // fewer sheets wins, then the one that wastes less texels
+                for (SortHeuristic candidate : { SortHeuristic::Height, SortHeuristic::Area, SortHeuristic::MaxSide, SortHeuristic::Perimeter }) {
+                    vector<SheetLayout> attempt = plan(candidate);
+                    if (!layouts.empty()) {
+                        if (attempt.size() > layouts.size()) continue;
+                        if (attempt.size() == layouts.size() && fillRatio(attempt) <= fillRatio(layouts)) continue;
+                    }
+                    layouts = std::move(attempt);
+                    chosen = candidate;
+                }
+            }
+            if (settings.multiBin && chosen == SortHeuristic::None) chosen = SortHeuristic::Area;
+            cout << "[Info] Planned " << images.size() << " images into " << layouts.size() << " sheet(s) using "
+                << RectPacker::Name(settings.packer) << (settings.multiBin ? " across all sheets" : "") << " and the \"" << sortHeuristicName(chosen) << "\" heuristic. Fill ratio: " << std::fixed << std::setprecision(2)
+                << fillRatio(layouts) * 100 << "%" << std::defaultfloat << endl;
+            return layouts;
+        }
+        void TexturePacker::composeSheet(ThreadPool& pool, int index, const SheetLayout& layout, vector<ImageData>& images, vector<unsigned char>& sheet) {
+            Trace::Span span(trace.get(), "compose", "compose", std::to_string(index));
+            // every image owns its own rect, so the workers never write to the same pixels
+            pool.ParallelFor(layout.rects.size(), [&](size_t r) {
+                const SpriteRect& rect = layout.rects[r];
+                // trimmed images are already decoded. they're owned by img from here on
+                ImageData img;
+                if (images[rect.id].data) {
+                    img = images[rect.id];
+                    images[rect.id].data = nullptr;
+                }
+                else {
+                    BuildStats::Scope decode(stats.get(), Stage::Decode, index);
+                    img = loadImage(images[rect.id].path);
+                    if (stats) decode.Bytes((int64_t)fs::file_size(img.path), (int64_t)img.width * img.height * STBI_rgb_alpha);
+                    decode.Items(1);
+                }
+                BuildStats::Scope compose(stats.get(), Stage::Compose, index);
+                Trace::Span blit(trace.get(), "blit", "compose", img.path);
+                compose.Items(1);
+                if (img.width != rect.w || img.height != rect.h) {
+                    stbi_image_free(img.data);
+                    throw std::runtime_error("Image changed while packing: " + img.path);
+                }
+                Blit::CopyRect(sheet.data(), layout.width, rect.x, rect.y, img.data, img.width, 0, 0, img.width, img.height);
+                // the manifest needs the hash of every image, duplicates already have it
+                if (settings.incremental && !settings.removeDuplicates) images[rect.id].hash = pixelHash(img);
+                stbi_image_free(img.data);  // Free the image data after use
+            });
+        }
+        void TexturePacker::encodeSheet(ThreadPool& pool, SheetJob& job) {
+            const int64_t pixelBytes = (int64_t)job.pixels.size();
+            if (!settings.UsesPngWriter()) {
+                BuildStats::Scope encode(stats.get(), Stage::Encode, job.index);
+                Trace::Span span(trace.get(), "stbi_write_png", "encode", std::to_string(job.index));
+                int length = 0;
+                unsigned char* png = stbi_write_png_to_mem(job.pixels.data(), job.width * STBI_rgb_alpha, job.width, job.height, STBI_rgb_alpha, &length);
+                if (!png) throw std::runtime_error("Failed to encode texture sheet " + std::to_string(job.index));
+                job.png.assign(png, png + length);
+                STBIW_FREE(png);
+                encode.Bytes(pixelBytes, length);
+                encode.Items(1);
+                return;
+            }
 
-                // Determine the actual minimum required texture size based on the packed rectangles
-                int required_width = 0, required_height = 0;
-                for (const auto& rect : rects) {
-                    required_width = std::max(required_width, rect.x + rect.w);
-                    required_height = std::max(required_height, rect.y + rect.h);
+            PngWriter::Options options;
+            options.level = settings.pngLevel;
+            options.filter = settings.pngFilter;
+            options.threads = settings.pngThreads;
+            if (settings.useCompression) {
+                // quantize the sheet in memory and write it as an indexed .png
+                Quantizer::Options quantizer;
+                quantizer.colors = settings.paletteColors;
+                quantizer.dither = settings.dither;
+                Quantizer::Result quantized;
+                {
+                    BuildStats::Scope quantize(stats.get(), Stage::Quantize, job.index);
+                    Trace::Span span(trace.get(), "quantize", "encode", std::to_string(job.index));
+                    quantized = Quantizer::Quantize(job.pixels.data(), job.width, job.height, quantizer, pool);
+                    quantize.Bytes(pixelBytes, (int64_t)quantized.indices.size());
+                    quantize.Items(1);
                 }
+                BuildStats::Scope encode(stats.get(), Stage::Encode, job.index);
+                Trace::Span span(trace.get(), "encode indexed png", "encode", std::to_string(job.index));
+                job.png = PngWriter::EncodeIndexed(quantized.indices.data(), job.width, job.height, quantized.palette, options, pool);
+                job.colors = quantized.Size();
+                encode.Bytes((int64_t)quantized.indices.size(), (int64_t)job.png.size());
+                encode.Items(1);
+            }
+            else {
+                BuildStats::Scope encode(stats.get(), Stage::Encode, job.index);
+                Trace::Span span(trace.get(), "encode png", "encode", std::to_string(job.index));
+                job.png = PngWriter::EncodeRGBA(job.pixels.data(), job.width, job.height, options, pool);
+                encode.Bytes(pixelBytes, (int64_t)job.png.size());
+                encode.Items(1);
+            }
+        }
+        void TexturePacker::writeSheet(const SheetJob& job, const SheetLayout& layout, const vector<ImageData>& images,
+            const vector<vector<ImageData>>& aliases, const fs::path& outputDir, const std::string& Group) {
+            for (const auto& rect : layout.rects)
+                cout << "[Info]     adding \"" << images[rect.id].path << "\"" << endl;
 
-                // Adjust the size to the nearest power of two
-                sheet_width = nextPowerOfTwo(required_width);
-                sheet_height = nextPowerOfTwo(required_height);
+            // Create output file path with postfix
+            std::string outputFileName = Group + "_" + std::to_string(job.index) + ".png";
+            fs::path outputFilePath = outputDir / outputFileName;
 
-                // Create blank texture sheet (RGBA)
-                std::vector<unsigned char> sheet(sheet_width * sheet_height * STBI_rgb_alpha, 0);
+            if (job.colors > 0) cout << "[Info] Reduced " << outputFileName << " to " << job.colors << " colors" << endl;
+            {
+                BuildStats::Scope write(stats.get(), Stage::Write, job.index);
+                Trace::Span span(trace.get(), "save png", "write", outputFilePath.string());
+                if (!SaveFileAtomically(outputFilePath, job.png))
+                    throw std::runtime_error("Failed to save texture sheet: " + outputFilePath.string());
+                write.Bytes(0, (int64_t)job.png.size());
+                write.Items(1);
+            }
+            cout << "[Info] Texture sheet saved to " << outputFilePath.string() << endl;
 
-                // Copy packed images into the texture sheet
-                for (const auto& rect : rects) {
-                    const ImageData& img = images[rect.id];
-                    for (int y = 0; y < img.height; ++y) {
-                        for (int x = 0; x < img.width; ++x) {
-                            int sheet_index = (rect.y + y) * sheet_width + (rect.x + x);
-                            int img_index = y * img.width + x;
-                            for (int c = 0; c < STBI_rgb_alpha; ++c) {
-                                sheet[sheet_index * STBI_rgb_alpha + c] = img.data[img_index * STBI_rgb_alpha + c];
-                            }
-                        }
-                    }
-                    cout << "[Info]     adding \"" << img.path << "\"" << endl;
-                    stbi_image_free(img.data);  // Free the image data after use
+            if (settings.useCompressionTool) {
+                BuildStats::Scope pngquant(stats.get(), Stage::Pngquant, job.index);
+                Trace::Span span(trace.get(), "pngquant", "write", outputFilePath.string());
+                optimizePngInOutputDir(outputFilePath);
+                pngquant.Items(1);
+            }
+            if (!settings.WritesJson()) return;
+            BuildStats::Scope json(stats.get(), Stage::Json, job.index);
+            Trace::Span span(trace.get(), "json", "write", outputFilePath.string());
+            json.Bytes(0, (int64_t)exportSpriteInfoToJson(layout, images, aliases, outputFilePath, settings));
+            json.Items(1);
+        }
+        void TexturePacker::writeBinaryMetadata(const vector<SheetLayout>& layouts, const vector<ImageData>& images,
+            const vector<vector<ImageData>>& aliases, const fs::path& outputDir, const std::string& Group) {
+            const fs::path path = outputDir / (Group + ".bin");
+            BuildStats::Scope binary(stats.get(), Stage::Binary);
+            Trace::Span span(trace.get(), "bin", "write", path.string());
+            // same sprites in the same order as the .json files
+            BinaryMetadata::Writer writer;
+            for (int sheet = 0; sheet < (int)layouts.size(); sheet++) {
+                const SheetLayout& layout = layouts[sheet];
+                writer.AddSheet(Group + "_" + std::to_string(sheet) + ".png", layout.width, layout.height);
+                for (const auto& rect : layout.rects) {
+                    auto add = [&](const ImageData& img) {
+                        const fs::path file(img.path);
+                        writer.AddSprite(file.stem().string(), file.extension().string(), rect.x, rect.y, rect.w, rect.h,
+                            img.sourceWidth, img.sourceHeight, img.offsetX, img.offsetY);
+                    };
+                    add(images[rect.id]);
+                    for (const auto& alias : aliases[rect.id]) add(alias);
+                }
+            }
+            const std::vector<uint8_t> file = writer.Encode(Group, settings.trim);
+            if (!SaveFileAtomically(path, file)) throw std::runtime_error("Failed to save the sprite metadata: " + path.string());
+            binary.Bytes(0, (int64_t)file.size());
+            binary.Items(1);
+            cout << "[Info] Sprite metadata saved to " << path << endl;
+        }
+        // the .png and .json of every sheet of a group, and its .bin
+        static vector<fs::path> sheetFiles(const fs::path& outputDir, const std::string& Group, int sheetCount, const PackingSettings& settings) {
+            vector<fs::path> files;
+            for (int sheet = 0; sheet < sheetCount; sheet++) {
+                files.push_back(outputDir / (Group + "_" + std::to_string(sheet) + ".png"));
+                if (settings.WritesJson()) files.push_back(outputDir / (Group + "_" + std::to_string(sheet) + ".json"));
+            }
+            if (settings.WritesBinary()) files.push_back(outputDir / (Group + ".bin"));
+            return files;
+        }
+        string TexturePacker::buildCacheKey(const vector<fs::path>& imagePaths) const {
+            // the contents of the files, the settings and the tool version
+            // the order is sorted, since it follows the directory listing which differs between machines
+            std::shared_ptr<ThreadPool> poolHandle = acquirePool(settings.threadCount);
+            ThreadPool& pool = *poolHandle;
+            vector<string> inputs(imagePaths.size());
+            pool.ParallelFor(imagePaths.size(), [&](size_t i) {
+                std::ifstream file(imagePaths[i], std::ios::binary);
+                if (!file.is_open()) throw std::runtime_error("Failed to read image: " + imagePaths[i].string());
+                std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                std::ostringstream input;
+                input << fs::relative(imagePaths[i], settings.InputDirectory).generic_string() << "\t" << std::hex << Hash64(bytes.data(), bytes.size());
+                inputs[i] = input.str();
+            });
+            std::sort(inputs.begin(), inputs.end());
+
+            std::ostringstream text;
+            text << "TexturePacker " << TEXTUREPACKER_VERSION << "\n" << "group=" << settings.Group << ";" << packingFingerprint() << "\n";
+            for (const auto& input : inputs) text << input << "\n";
+            return BuildCache::MakeKey(text.str());
+        }
+        bool TexturePacker::restoreFromCache(BuildCache& cache, const string& key) {
+            vector<fs::path> restored;
+            if (!cache.Restore(key, settings.OutputDirectory, settings.cacheHardLinks, restored)) return false;
+
+            // the .json files point at the sheet of the machine that built them
+            for (const auto& file : restored) {
+                if (file.extension() != ".json") continue;
+                nlohmann::json json;
+                {
+                    std::ifstream input(file);
+                    input >> json;
+                }
+                json["texture"] = (settings.OutputDirectory / fs::path(json["texture"].get<string>()).filename()).string();
+                // a new file, so a hard link into the cache is never written through
+                fs::remove(file);
+                std::ofstream output(file);
+                if (!output.is_open()) throw std::runtime_error("Failed to open JSON file for writing: " + file.string());
+                output << json.dump(4);
+            }
+            // the manifest describes the files that were just replaced
+            if (settings.incremental) fs::remove(Manifest::PathFor(settings.OutputDirectory, settings.Group));
+            cout << "[Info] Restored " << restored.size() << " file(s) of \"" << settings.Group << "\" from the build cache" << endl;
+            return true;
+        }
+        string TexturePacker::packingFingerprint() const {
+            std::ostringstream fingerprint;
+            fingerprint << "size=" << settings.MaxTextureSize
+                << ";packer=" << RectPacker::Name(settings.packer)
+                << ";heuristic=" << sortHeuristicName(settings.heuristic)
+                << ";multibin=" << settings.multiBin
+                << ";trim=" << settings.trim
+                << ";dedup=" << settings.removeDuplicates
+                << ";png=" << settings.pngLevel << "," << PngWriter::FilterName(settings.pngFilter) << "," << settings.pngThreads
+                << ";compress=" << settings.useCompression << "," << settings.paletteColors << "," << settings.dither << "," << settings.useCompressionTool
+                << ";meta=" << settings.WritesJson() << "," << settings.WritesBinary();
+            return fingerprint.str();
+        }
+        string TexturePacker::settingsFingerprint(const fs::path& outputDir) const {
+            // the .json files hold the output path, and the pivots once they were overridden
+            // a removed rule leaves its pivot behind in the sheets that are kept, so the rules themselves are part of it
+            std::ostringstream pivots;
+            if (settings.overridePivot) {
+                pivots << settings.RulesDirectory.string();
+                for (const auto& rulesPath : pivotRulesFiles()) {
+                    std::ifstream file(rulesPath, std::ios::binary);
+                    const std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                    pivots << "," << std::hex << Hash64(bytes.data(), bytes.size());
                 }
+            }
+            return "output=" + outputDir.string() + ";" + packingFingerprint() + ";pivot=" + pivots.str();
+        }
+        bool TexturePacker::reusePreviousBuild(ThreadPool& pool, const Manifest& previous, const vector<fs::path>& imagePaths, const vector<FileStamp>& stamps,
+            vector<ImageData>& images, vector<vector<ImageData>>& aliases, vector<SheetLayout>& layouts, vector<bool>& dirty,
+            const fs::path& outputDir, const std::string& Group) {
+            // added or removed images change the layout
+            if (previous.images.size() != imagePaths.size()) return false;
+            std::unordered_map<string, size_t> inputs;
+            for (size_t i = 0; i < imagePaths.size(); i++) inputs[imagePaths[i].string()] = i;
+            vector<size_t> inputOf(previous.images.size());
+            for (size_t entry = 0; entry < previous.images.size(); entry++) {
+                auto found = inputs.find(previous.images[entry].path);
+                if (found == inputs.end()) return false;
+                inputOf[entry] = found->second;
+            }
 
-                // Create output file path with postfix
-                std::string outputFileName = Group + "_" + std::to_string(textureIndex) + ".png";
-                fs::path outputFilePath = outputDir / outputFileName;
+            // the images and layouts as they were planned last time
+            vector<ImageData> plannedImages;
+            vector<vector<ImageData>> plannedAliases;
+            vector<SheetLayout> plannedLayouts = previous.sheets;
+            // entry -> image id, aliases point at their original
+            vector<int> imageOf(previous.images.size(), -1);
+            for (size_t entry = 0; entry < previous.images.size(); entry++) {
+                const ManifestImage& image = previous.images[entry];
+                ImageData img;
+                img.path = image.path;
+                img.width = image.rect.w;
+                img.height = image.rect.h;
+                img.sourceWidth = image.sourceWidth;
+                img.sourceHeight = image.sourceHeight;
+                img.offsetX = image.offsetX;
+                img.offsetY = image.offsetY;
+                img.hash = image.hash;
+                if (image.alias) {
+                    if (plannedImages.empty()) return false;
+                    plannedAliases.back().push_back(img);
+                    continue;
+                }
+                SpriteRect rect = image.rect;
+                rect.id = (int)plannedImages.size();
+                imageOf[entry] = rect.id;
+                plannedLayouts[image.sheet].rects.push_back(rect);
+                plannedImages.push_back(img);
+                plannedAliases.emplace_back();
+            }
 
-                if (!stbi_write_png(
-                    outputFilePath.string().c_str(),
-                    sheet_width, sheet_height, STBI_rgb_alpha,
-                    sheet.data(), sheet_width * STBI_rgb_alpha)) {
-                    throw std::runtime_error("Failed to save texture sheet: " + outputFilePath.string());
+            // images whose file changed are decoded to see if their pixels did too
+            vector<size_t> touched;
+            for (size_t entry = 0; entry < previous.images.size(); entry++)
+                if (!(stamps[inputOf[entry]] == previous.images[entry].stamp)) touched.push_back(entry);
+            vector<ImageData> decoded(touched.size());
+            auto freeDecoded = [&] {
+                for (auto& img : decoded) stbi_image_free(img.data);
+                for (auto& img : plannedImages) stbi_image_free(img.data);
+            };
+            try {
+                pool.ParallelFor(touched.size(), [&](size_t t) {
+                    const fs::path& path = imagePaths[inputOf[touched[t]]];
+                    decoded[t] = settings.trim ? loadTrimmedImage(path) : loadImage(path);
+                    decoded[t].hash = pixelHash(decoded[t]);
+                });
+            }
+            catch (...) {
+                freeDecoded();
+                throw;
+            }
+
+            vector<bool> changedSheets(plannedLayouts.size(), false);
+            for (size_t t = 0; t < touched.size(); t++) {
+                const ManifestImage& image = previous.images[touched[t]];
+                ImageData& img = decoded[t];
+                bool samePixels = img.hash == image.hash && img.width == image.rect.w && img.height == image.rect.h;
+                bool samePlacement = img.sourceWidth == image.sourceWidth && img.sourceHeight == image.sourceHeight &&
+                    img.offsetX == image.offsetX && img.offsetY == image.offsetY;
+                if (samePixels && samePlacement) continue;
+                // the rect only fits an image of the same size. with duplicates, a change can also add or remove a copy
+                if (settings.removeDuplicates || img.width != image.rect.w || img.height != image.rect.h) {
+                    freeDecoded();
+                    return false;
                 }
-                cout << "[Info] Texture sheet saved to " << outputFilePath.string() << endl;
+                changedSheets[image.sheet] = true;
+                // the decoded pixels go straight into the sheet
+                plannedImages[imageOf[touched[t]]] = img;
+                img.data = nullptr;
+            }
+            for (auto& img : decoded) stbi_image_free(img.data);
 
-                if (settings.useCompression) optimizePngInOutputDir(outputFilePath);
-                exportSpriteInfoToJson(rects, images, outputFilePath,settings);
+            // sheets whose files are gone are composed again as well
+            for (int sheet = 0; sheet < (int)plannedLayouts.size(); sheet++) {
+                fs::path sheetPath = outputDir / (Group + "_" + std::to_string(sheet) + ".png");
+                if (!fs::exists(sheetPath) || (settings.WritesJson() && !fs::exists(fs::path(sheetPath).replace_extension(".json")))) changedSheets[sheet] = true;
+            }
+            // composing a trimmed image needs its trimmed pixels
+            if (settings.trim) {
+                vector<int> pending;
+                for (int sheet = 0; sheet < (int)plannedLayouts.size(); sheet++) {
+                    if (!changedSheets[sheet]) continue;
+                    for (const auto& rect : plannedLayouts[sheet].rects)
+                        if (!plannedImages[rect.id].data) pending.push_back(rect.id);
+                }
+                try {
+                    pool.ParallelFor(pending.size(), [&](size_t p) {
+                        ImageData& img = plannedImages[pending[p]];
+                        img = loadTrimmedImage(img.path);
+                    });
+                }
+                catch (...) {
+                    for (auto& img : plannedImages) stbi_image_free(img.data);
+                    throw;
+                }
+            }
 
-                // Move to the next batch of images
-                start += current_count;
-                textureIndex++;
+            images = std::move(plannedImages);
+            aliases = std::move(plannedAliases);
+            layouts = std::move(plannedLayouts);
+            dirty = std::move(changedSheets);
+            return true;
+        }
+        Manifest TexturePacker::buildManifest(const vector<fs::path>& imagePaths, const vector<FileStamp>& stamps, const vector<ImageData>& images,
+            const vector<vector<ImageData>>& aliases, const vector<SheetLayout>& layouts, const fs::path& outputDir) {
+            std::unordered_map<string, size_t> inputs;
+            for (size_t i = 0; i < imagePaths.size(); i++) inputs[imagePaths[i].string()] = i;
+
+            Manifest manifest;
+            manifest.settings = settingsFingerprint(outputDir);
+            for (int sheet = 0; sheet < (int)layouts.size(); sheet++) {
+                SheetLayout size;
+                size.width = layouts[sheet].width;
+                size.height = layouts[sheet].height;
+                manifest.sheets.push_back(size);
+
+                // same order as the .json
+                for (const auto& rect : layouts[sheet].rects) {
+                    auto add = [&](const ImageData& img, bool alias) {
+                        ManifestImage image;
+                        image.path = img.path;
+                        image.stamp = stamps[inputs.at(img.path)];
+                        image.hash = img.hash;
+                        image.sheet = sheet;
+                        image.rect = rect;
+                        image.sourceWidth = img.sourceWidth;
+                        image.sourceHeight = img.sourceHeight;
+                        image.offsetX = img.offsetX;
+                        image.offsetY = img.offsetY;
+                        image.alias = alias;
+                        manifest.images.push_back(image);
+                    };
+                    add(images[rect.id], false);
+                    for (const auto& alias : aliases[rect.id]) add(alias, true);
+                }
+            }
+            return manifest;
+        }
+        std::shared_ptr<ThreadPool> TexturePacker::acquirePool(int threadCount) const {
+            if (sharedPool) return sharedPool;
+            return std::make_shared<ThreadPool>(threadCount);
+        }
+        // Pack images into texture sheets and handle multiple sheets if needed
+        vector<fs::path> TexturePacker::packImagesIntoSheets(const std::vector<fs::path>& imagePaths, const fs::path& outputDir, const std::string& Group, bool& keptSheets) {
+            // Ensure output directory exists
+            if (!fs::exists(outputDir)) fs::create_directories(outputDir);
+
+            // the pool has to be big enough for the png bands as well
+            std::shared_ptr<ThreadPool> poolHandle = acquirePool(std::max(ThreadPool::ResolveThreadCount(settings.threadCount), settings.pngThreads));
+            ThreadPool& pool = *poolHandle;
+
+            vector<ImageData> images;
+            vector<vector<ImageData>> aliases;
+            vector<SheetLayout> layouts;
+            // sheets to compose. all of them unless the last build is reused
+            vector<bool> dirty;
+
+            // an incremental build starts from the manifest of the last one when the settings match
+            vector<FileStamp> stamps;
+            Manifest previous;
+            bool hasPrevious = false, reused = false;
+            const fs::path manifestPath = Manifest::PathFor(outputDir, Group);
+            if (settings.incremental) {
+                stamps.resize(imagePaths.size());
+                pool.ParallelFor(imagePaths.size(), [&](size_t i) { stamps[i] = FileStamp::Read(imagePaths[i]); });
+                hasPrevious = previous.Load(manifestPath);
+                reused = hasPrevious && previous.settings == settingsFingerprint(outputDir) &&
+                    reusePreviousBuild(pool, previous, imagePaths, stamps, images, aliases, layouts, dirty, outputDir, Group);
+            }
+            keptSheets = reused;
+            if (reused) {
+                int changed = (int)std::count(dirty.begin(), dirty.end(), true);
+                if (changed == 0) {
+                    // only the stamps of touched files can differ
+                    buildManifest(imagePaths, stamps, images, aliases, layouts, outputDir).Save(manifestPath);
+                    // the .bin is kept like the .json files, so both still carry the pivots of the same rules
+                    if (settings.WritesBinary() && !fs::exists(outputDir / (Group + ".bin"))) writeBinaryMetadata(layouts, images, aliases, outputDir, Group);
+                    cout << "[Info] Nothing changed since the last build of \"" << Group << "\". Skipping" << endl;
+                    return sheetFiles(outputDir, Group, (int)layouts.size(), settings);
+                }
+                cout << "[Info] Keeping the layout of the last build. Rebuilding " << changed << " of " << layouts.size() << " sheet(s)" << endl;
+            }
+            else {
+                // Read the sizes only and plan every sheet before decoding any pixels
+                // trimming and finding duplicates need the pixels, those images stay decoded until they are composed
+                images.assign(imagePaths.size(), ImageData());
+                try {
+                    pool.ParallelFor(imagePaths.size(), [&](size_t i) {
+                        // reading only the header is part of scanning the input
+                        const bool decodes = settings.trim || settings.removeDuplicates;
+                        BuildStats::Scope decode(stats.get(), decodes ? Stage::Decode : Stage::Scan);
+                        if (settings.trim) images[i] = loadTrimmedImage(imagePaths[i]);
+                        else if (settings.removeDuplicates) images[i] = loadImage(imagePaths[i]);
+                        else images[i] = probeImage(imagePaths[i]);
+                        if (settings.removeDuplicates) images[i].hash = pixelHash(images[i]);
+                        if (stats && decodes) {
+                            decode.Bytes((int64_t)fs::file_size(imagePaths[i]), (int64_t)images[i].sourceWidth * images[i].sourceHeight * STBI_rgb_alpha);
+                            decode.Items(1);
+                        }
+                    });
+                    BuildStats::Scope plan(stats.get(), Stage::Plan);
+                    if (settings.removeDuplicates) removeDuplicateImages(images, aliases);
+                    else aliases.resize(images.size());
+                    layouts = planSheets(images);
+                    plan.Items((int64_t)images.size());
+                }
+                catch (...) {
+                    for (auto& img : images) stbi_image_free(img.data);
+                    throw;
+                }
+                dirty.assign(layouts.size(), true);
+            }
+            if (settings.incremental) {
+                // a cancelled build must not leave a manifest describing sheets it didn't write
+                fs::remove(manifestPath);
+                // sheets the last build had and this one doesn't
+                for (int sheet = (int)layouts.size(); hasPrevious && sheet < (int)previous.sheets.size(); sheet++) {
+                    fs::remove(outputDir / (Group + "_" + std::to_string(sheet) + ".png"));
+                    fs::remove(outputDir / (Group + "_" + std::to_string(sheet) + ".json"));
+                }
+            }
+
+            /*
+            * sheets go through a pipeline: this thread composes sheet N+1 while sheet N is encoded
+            * and sheet N-1 is written. a slot is taken before composing and given back once the sheet
+            * is written, so no more than sheetsInFlight sheet buffers exist at once
+            */
+            std::counting_semaphore<> slots(std::max(1, settings.sheetsInFlight));
+            BlockingQueue<SheetJob> toEncode, toWrite;
+            std::exception_ptr error;
+            std::mutex errorMutex;
+            std::atomic<bool> failed = false;
+            auto fail = [&] {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            };
+
+            // after a failure the stages keep draining their queue so every slot is given back
+            // the waits show where the pipeline runs dry
+            auto pop = [&](BlockingQueue<SheetJob>& queue, SheetJob& job) {
+                Trace::Span span(trace.get(), "wait for sheet", "pipeline");
+                return queue.Pop(job);
+            };
+            std::thread encoder([&] {
+                if (trace) trace->NameThread("encoder");
+                SheetJob job;
+                while (pop(toEncode, job)) {
+                    if (!failed) {
+                        try { encodeSheet(pool, job); }
+                        catch (...) { fail(); }
+                    }
+                    job.pixels = {};
+                    toWrite.Push(std::move(job));
+                }
+                toWrite.Close();
+            });
+            // the writer is the only stage printing, so the log stays in sheet order
+            std::thread writer([&] {
+                if (trace) trace->NameThread("writer");
+                SheetJob job;
+                while (pop(toWrite, job)) {
+                    if (!failed) {
+                        try { writeSheet(job, layouts[job.index], images, aliases, outputDir, Group); }
+                        catch (...) { fail(); }
+                    }
+                    job = {};
+                    slots.release();
+                }
+            });
+
+            for (int textureIndex = 0; textureIndex < (int)layouts.size(); textureIndex++) {
+                if (!dirty[textureIndex]) continue;
+                {
+                    Trace::Span span(trace.get(), "wait for slot", "pipeline");
+                    slots.acquire();
+                }
+                if (failed) break;
+                const SheetLayout& layout = layouts[textureIndex];
+
+                // Create blank texture sheet (RGBA) and decode each image straight into it
+                SheetJob job;
+                job.index = textureIndex;
+                job.width = layout.width;
+                job.height = layout.height;
+                job.pixels.assign((size_t)layout.width * layout.height * STBI_rgb_alpha, 0);
+                if (stats) stats->AddSheet(textureIndex, layout.width, layout.height, (int)layout.rects.size());
+                try { composeSheet(pool, textureIndex, layout, images, job.pixels); }
+                catch (...) {
+                    fail();
+                    break;
+                }
+                toEncode.Push(std::move(job));
+            }
+            toEncode.Close();
+            encoder.join();
+            writer.join();
+            if (error) {
+                // the sheets that were never composed still hold their trimmed or deduplicated images
+                freeImages(images);
+                std::rethrow_exception(error);
             }
+
+            if (settings.WritesBinary()) writeBinaryMetadata(layouts, images, aliases, outputDir, Group);
+            if (settings.incremental) buildManifest(imagePaths, stamps, images, aliases, layouts, outputDir).Save(manifestPath);
+            return sheetFiles(outputDir, Group, (int)layouts.size(), settings);
         }
 
         void TexturePacker::checkIfCanAddImage(vector<fs::path>& images,const std::filesystem::directory_entry& entry)
@@ -247,39 +1154,375 @@ namespace QLE {
         }
         bool TexturePacker::Pack(PackingSettings settings) {
             this->settings = settings;
+            stats = settings.stats ? std::make_shared<BuildStats>(settings.Group) : nullptr;
+            startTrace();
 
             cout << "[Info] Texture Packing Started" << endl;
 
             std::vector<fs::path> images;
 
             // Traverse directories and subdirectories
-            if (settings.recursive) {
-                for (const auto& entry : fs::recursive_directory_iterator(settings.InputDirectory))
-                    checkIfCanAddImage(images, entry);
+            {
+                BuildStats::Scope scan(stats.get(), Stage::Scan);
+                Trace::Span span(trace.get(), "scan", "scan", settings.InputDirectory.string());
+                if (settings.recursive) {
+                    for (const auto& entry : fs::recursive_directory_iterator(settings.InputDirectory))
+                        checkIfCanAddImage(images, entry);
+                }
+                else {
+                    for (const auto& entry : fs::directory_iterator(settings.InputDirectory))
+                        checkIfCanAddImage(images, entry);
+                }
+                scan.Items((int64_t)images.size());
             }
-            else {
-                for (const auto& entry : fs::directory_iterator(settings.InputDirectory))
-                    checkIfCanAddImage(images, entry);
+            return packListedImages(images);
+        }
+        bool TexturePacker::Pack(PackingSettings settings, const vector<fs::path>& images) {
+            this->settings = settings;
+            stats = settings.stats ? std::make_shared<BuildStats>(settings.Group) : nullptr;
+            startTrace();
+
+            cout << "[Info] Texture Packing Started" << endl;
+            return packListedImages(images);
+        }
+        Atlas TexturePacker::PackAtlas(std::span<const AtlasImage> sources, PackingSettings settings, bool encode) {
+            this->settings = settings;
+            // nothing to time or trace without the files to save them to
+            stats.reset();
+            trace.reset();
+            Atlas atlas;
+            if (sources.empty()) return atlas;
+
+            std::shared_ptr<ThreadPool> poolHandle = acquirePool(std::max(ThreadPool::ResolveThreadCount(settings.threadCount), settings.pngThreads));
+            ThreadPool& pool = *poolHandle;
+
+            // every image is decoded up front, there is no file to go back to when composing
+            vector<ImageData> images(sources.size());
+            vector<vector<ImageData>> aliases;
+            vector<SheetLayout> layouts;
+            try {
+                pool.ParallelFor(sources.size(), [&](size_t i) {
+                    images[i] = loadImage(sources[i]);
+                    images[i].index = (int)i;
+                    if (settings.trim) trimImage(images[i]);
+                    if (settings.removeDuplicates) images[i].hash = pixelHash(images[i]);
+                });
+                if (settings.removeDuplicates) removeDuplicateImages(images, aliases);
+                else aliases.resize(images.size());
+                layouts = planSheets(images);
+            }
+            catch (...) {
+                freeImages(images);
+                throw;
             }
 
+            atlas.sprites.resize(sources.size());
+            try {
+                for (int sheet = 0; sheet < (int)layouts.size(); sheet++) {
+                    const SheetLayout& layout = layouts[sheet];
+                    for (const auto& rect : layout.rects) {
+                        auto place = [&](const ImageData& img) {
+                            AtlasSprite& sprite = atlas.sprites[img.index];
+                            sprite.name = sources[img.index].name;
+                            sprite.image = img.index;
+                            sprite.sheet = sheet;
+                            sprite.x = rect.x;
+                            sprite.y = rect.y;
+                            sprite.width = rect.w;
+                            sprite.height = rect.h;
+                            sprite.sourceWidth = img.sourceWidth;
+                            sprite.sourceHeight = img.sourceHeight;
+                            sprite.offsetX = img.offsetX;
+                            sprite.offsetY = img.offsetY;
+                        };
+                        place(images[rect.id]);
+                        for (const auto& alias : aliases[rect.id]) place(alias);
+                    }
+
+                    // the images are freed as they are copied into the sheet
+                    SheetJob job;
+                    job.index = sheet;
+                    job.width = layout.width;
+                    job.height = layout.height;
+                    job.pixels.assign((size_t)layout.width * layout.height * STBI_rgb_alpha, 0);
+                    composeSheet(pool, sheet, layout, images, job.pixels);
+                    if (encode) encodeSheet(pool, job);
+
+                    AtlasSheet& result = atlas.sheets.emplace_back();
+                    result.width = job.width;
+                    result.height = job.height;
+                    result.pixels = std::move(job.pixels);
+                    result.png = std::move(job.png);
+                    result.colors = job.colors;
+                }
+            }
+            catch (...) {
+                // the images of the sheets after the failing one were never copied
+                freeImages(images);
+                throw;
+            }
+            return atlas;
+        }
+        void TexturePacker::startTrace() {
+            trace = settings.TraceFile.empty() ? nullptr : std::make_shared<Trace>();
+            if (trace) trace->NameThread("main");
+        }
+        void TexturePacker::saveTrace() {
+            if (!trace) return;
+            // the trace is about the build, failing to save it doesn't fail the build
+            try {
+                trace->Save(settings.TraceFile);
+                cout << "[Info] Trace saved to " << settings.TraceFile << endl;
+            }
+            catch (const std::exception& e) {
+                cerr << "[Error] " << e.what() << endl;
+            }
+        }
+        bool TexturePacker::packListedImages(const vector<fs::path>& images) {
             if (images.empty()) {
                 cerr << "[Error] No images found in the directory." << endl;
                 return false;
             }
+            // Watch forgets the images no build lists anymore. a server cache is shared by jobs of other groups, which keep theirs
+            if (imageCache) {
+                for (const auto& image : images) listedImages.insert(image.string());
+            }
 
             try {
-                packImagesIntoSheets(images, settings.OutputDirectory, settings.Group);
-                if(settings.overridePivot) overridePivot();
+                // finished builds are looked up by the contents of their inputs before building anything
+                std::unique_ptr<BuildCache> cache;
+                string cacheKey;
+                if (!settings.CacheDirectory.empty()) {
+                    cache = std::make_unique<BuildCache>(settings.CacheDirectory, (uintmax_t)settings.cacheSizeMB * 1024 * 1024);
+                    cacheKey = buildCacheKey(images);
+                }
+                bool restored = false;
+                if (cache) {
+                    Trace::Span span(trace.get(), "restore from cache", "cache", cacheKey);
+                    restored = restoreFromCache(*cache, cacheKey);
+                }
+                if (!restored) {
+                    bool keptSheets = false;
+                    vector<fs::path> files = packImagesIntoSheets(images, settings.OutputDirectory, settings.Group, keptSheets);
+                    // kept sheets still hold the pivots of the last run. the key leaves the pivots out, since a restore applies them again
+                    if (cache && keptSheets && settings.overridePivot)
+                        cout << "[Info] Not storing the build in the cache, its kept sheets have overridden pivots" << endl;
+                    else if (cache) {
+                        // a cache that can't be written to only costs the next build some time
+                        try {
+                            Trace::Span span(trace.get(), "insert into cache", "cache", cacheKey);
+                            cache->Insert(cacheKey, files);
+                            cache->Trim();
+                        }
+                        catch (const std::exception& e) {
+                            cerr << "[Error] Failed to store the build in the cache: " << e.what() << endl;
+                        }
+                    }
+                }
+                if (settings.overridePivot) {
+                    BuildStats::Scope pivot(stats.get(), Stage::Pivot);
+                    Trace::Span span(trace.get(), "override pivots", "pivot");
+                    overridePivot();
+                }
+                if (stats) {
+                    stats->Finish((int64_t)images.size());
+                    stats->Print(cout);
+                    // the stats are about the build, failing to save them doesn't fail the build
+                    if (!settings.StatsFile.empty()) {
+                        try { stats->Save(settings.StatsFile); }
+                        catch (const std::exception& e) {
+                            cerr << "[Error] " << e.what() << endl;
+                        }
+                    }
+                }
             }
             catch (const std::exception& e) {
                 cerr << "[Error] " << e.what() << endl;
+                // a failed build is worth looking at too
+                saveTrace();
                 return false;
             }
+            saveTrace();
 
             cout << "[Info] Texture Packing Completed" << endl;
             return true;
         }
 
+        bool TexturePacker::Watch(PackingSettings settings) {
+            // the manifest keeps the layout between builds and the cache keeps the decoded images
+            settings.incremental = true;
+            if (!imageCache) imageCache = std::make_shared<ImageCache>();
+            // a broken first build is fixed by the next change, so keep watching either way
+            Pack(settings);
+
+            DirectoryWatcher watcher(settings.InputDirectory, settings.recursive, [this](const fs::path& path) {
+                std::string ext = path.extension().string();
+                std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+                return IsExtensionSupported(ext);
+            });
+            cout << "[Info] Watching " << settings.InputDirectory << (watcher.UsesNotifications() ? "" : " (polling)") << " for changes. Press Ctrl+C to stop" << endl;
+            while (true) {
+                watcher.WaitForChanges(std::chrono::milliseconds(settings.watchDebounceMs));
+                auto start = std::chrono::steady_clock::now();
+                listedImages.clear();
+                bool packed = Pack(settings);
+                // images that were deleted or renamed don't need to stay decoded
+                if (packed) imageCache->Retain(listedImages);
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                cout << "[Info] " << (packed ? "Rebuilt" : "Failed to rebuild") << " in " << elapsed.count() << " ms. "
+                    << imageCache->Count() << " image(s) in memory (" << imageCache->Bytes() / (1024 * 1024) << " MB)" << endl;
+            }
+        }
+
+        // absolute, without a trailing separator, so folders compare equal however they were written
+        static fs::path normalizedFolder(const fs::path& folder) {
+            fs::path normalized = fs::absolute(folder).lexically_normal();
+            if (!normalized.has_filename() && normalized.has_relative_path()) normalized = normalized.parent_path();
+            return normalized;
+        }
+        // path of the file relative to folder, empty if it's outside of it
+        static fs::path pathInside(const fs::path& file, const fs::path& folder) {
+            fs::path relative = file.lexically_relative(folder);
+            if (relative.empty() || *relative.begin() == "..") return {};
+            return relative;
+        }
+        bool TexturePacker::PackProject(const fs::path& projectFile, const vector<string>& options) {
+            auto start = std::chrono::steady_clock::now();
+            std::ifstream file(projectFile);
+            if (!file.is_open()) {
+                cerr << "[Error] Failed to open the project file " << projectFile << endl;
+                return false;
+            }
+
+            struct Group {
+                PackingSettings settings;
+                vector<fs::path> images;
+            };
+            vector<Group> groups;
+            try {
+                nlohmann::json project;
+                file >> project;
+                if (!project.contains("groups") || !project["groups"].is_array() || project["groups"].empty())
+                    throw std::runtime_error("it has no \"groups\"");
+
+                // paths in the file are relative to the file
+                const fs::path base = fs::absolute(projectFile).parent_path();
+                auto resolve = [&](const nlohmann::json& path) { return normalizedFolder(base / path.get<string>()).string(); };
+                auto addOptions = [&](const nlohmann::json& node, vector<string>& args) {
+                    if (node.contains("input")) args.push_back("-i=" + resolve(node["input"]));
+                    if (node.contains("output")) args.push_back("-o=" + resolve(node["output"]));
+                    if (node.contains("group")) args.push_back("-group=" + node["group"].get<string>());
+                    if (node.contains("size")) args.push_back("-size=" + std::to_string(node["size"].get<int>()));
+                    if (node.contains("pivot")) args.push_back("-pivot=" + resolve(node["pivot"]));
+                    if (node.contains("compress")) {
+                        if (node["compress"].is_string()) args.push_back("-compress=" + node["compress"].get<string>());
+                        else if (node["compress"].get<bool>()) args.push_back("-compress");
+                    }
+                    if (node.contains("options")) for (const auto& option : node["options"]) args.push_back(option.get<string>());
+                };
+
+                std::unordered_set<string> outputs;
+                for (const auto& entry : project["groups"]) {
+                    // the command line, then the keys of the project, then the keys of the group
+                    vector<string> args = { "-p" };
+                    args.insert(args.end(), options.begin(), options.end());
+                    addOptions(project, args);
+                    addOptions(entry, args);
+
+                    Group group;
+                    if (parseArguments(args, group.settings) != PackingMode::Pack)
+                        throw std::runtime_error("group \"" + entry.value("group", string()) + "\" has invalid options");
+                    if (group.settings.watch)
+                        throw std::runtime_error("-watch can't be used with -project");
+                    group.settings.InputDirectory = normalizedFolder(group.settings.InputDirectory);
+                    // every group writes its own stats and trace next to the file that was asked for
+                    for (fs::path* perGroup : { &group.settings.StatsFile, &group.settings.TraceFile }) {
+                        if (perGroup->empty() || project["groups"].size() == 1) continue;
+                        *perGroup = perGroup->parent_path() / (perGroup->stem().string() + "_" + group.settings.Group + perGroup->extension().string());
+                    }
+                    group.settings.OutputDirectory = normalizedFolder(group.settings.OutputDirectory);
+                    if (!outputs.insert((group.settings.OutputDirectory / group.settings.Group).string()).second)
+                        throw std::runtime_error("group \"" + group.settings.Group + "\" is written to " + group.settings.OutputDirectory.string() + " more than once");
+                    groups.push_back(std::move(group));
+                }
+            }
+            catch (const std::exception& e) {
+                cerr << "[Error] Invalid project file " << projectFile << ": " << e.what() << endl;
+                return false;
+            }
+
+            // every folder is listed once. groups inside a folder that was listed recursively take their images from that listing
+            // the parents are listed first, and a subtree keeps the order it has when listing it on its own
+            struct Listing {
+                fs::path folder;
+                bool recursive;
+                vector<fs::path> images;
+            };
+            vector<Listing> listings;
+            vector<size_t> byDepth(groups.size());
+            for (size_t i = 0; i < groups.size(); i++) byDepth[i] = i;
+            std::stable_sort(byDepth.begin(), byDepth.end(), [&](size_t a, size_t b) {
+                return groups[a].settings.InputDirectory.string().size() < groups[b].settings.InputDirectory.string().size();
+            });
+            for (size_t index : byDepth) {
+                Group& group = groups[index];
+                const fs::path& input = group.settings.InputDirectory;
+                const Listing* source = nullptr;
+                for (const auto& listing : listings) {
+                    bool covers = listing.folder == input ? listing.recursive || !group.settings.recursive
+                        : listing.recursive && !pathInside(input, listing.folder).empty();
+                    if (covers) {
+                        source = &listing;
+                        break;
+                    }
+                }
+                if (!source) {
+                    Listing listing{ input, group.settings.recursive, {} };
+                    if (listing.recursive) {
+                        for (const auto& entry : fs::recursive_directory_iterator(input)) checkIfCanAddImage(listing.images, entry);
+                    }
+                    else {
+                        for (const auto& entry : fs::directory_iterator(input)) checkIfCanAddImage(listing.images, entry);
+                    }
+                    listings.push_back(std::move(listing));
+                    source = &listings.back();
+                }
+                for (const auto& image : source->images) {
+                    fs::path relative = pathInside(image, input);
+                    if (relative.empty() || (!group.settings.recursive && relative.has_parent_path())) continue;
+                    group.images.push_back(image);
+                }
+            }
+
+            // the biggest groups start first, the small ones fill the threads that free up afterwards
+            // sized like the pool of a single build, so every group gets the threads its -threads and -png-threads ask for
+            int threadCount = 1;
+            for (const auto& group : groups)
+                threadCount = std::max({ threadCount, ThreadPool::ResolveThreadCount(group.settings.threadCount), group.settings.pngThreads });
+            auto pool = std::make_shared<ThreadPool>(threadCount);
+            vector<size_t> bySize = byDepth;
+            std::stable_sort(bySize.begin(), bySize.end(), [&](size_t a, size_t b) { return groups[a].images.size() > groups[b].images.size(); });
+            vector<char> packed(groups.size(), false);
+            pool->ParallelFor(bySize.size(), [&](size_t i) {
+                const Group& group = groups[bySize[i]];
+                // a copy keeps the settings of every group apart
+                TexturePacker packer(*this);
+                packer.SetThreadPool(pool);
+                packed[bySize[i]] = packer.Pack(group.settings, group.images);
+            });
+
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            int failed = 0;
+            for (size_t i = 0; i < groups.size(); i++) {
+                if (packed[i]) continue;
+                cerr << "[Error] Failed to pack group \"" << groups[i].settings.Group << "\"" << endl;
+                failed++;
+            }
+            cout << "[Info] Packed " << groups.size() - failed << " of " << groups.size() << " group(s) from " << listings.size()
+                << " folder listing(s) in " << elapsed.count() << " ms" << endl;
+            return failed == 0;
+        }
+
         void TexturePacker::optimizePngInOutputDir(fs::path spritesheet)
         {
             if (!IsCompressionToolInPath()) {
@@ -312,13 +1555,7 @@ namespace QLE {
         // Function to extract sprites from the texture sheet using data from the JSON file
         void TexturePacker::extractSpritesFromJson(const fs::path& jsonFilePath) {
             // Load the JSON file
-            std::ifstream inputFile(jsonFilePath);
-            if (!inputFile.is_open()) {
-                throw std::runtime_error("Failed to open JSON file: " + jsonFilePath.string());
-            }
-            nlohmann::json jsonInput;
-            inputFile >> jsonInput;
-            inputFile.close();
+            const SheetJson sheet = SheetJson::Read(jsonFilePath);
 
             // Load the texture sheet
             const fs::path& textureSheetPath = jsonFilePath.parent_path() / jsonFilePath.filename().replace_extension(".png");
@@ -328,33 +1565,35 @@ namespace QLE {
                 throw std::runtime_error("Failed to load texture sheet: " + textureSheetPath.string() + ". Check if the image is missing or is corrupt.");
 
             // Process each sprite from the JSON data
-            std::string group = jsonInput["group"];
+            const std::string& group = sheet.group;
 
             // Create the directories if needed
             fs::path outputPath = settings.OutputDirectory / fs::path(group);
             if (!fs::exists(outputPath)) fs::create_directories(outputPath);
 
             // grab a sprite and export it
-            for (const auto& sprite : jsonInput["sprites"]) {
-                std::string fileName = sprite["name"];
-                std::string extension = sprite["extension"];
-                int x = sprite["position"]["x"];
-                int y = sprite["position"]["y"];
-                int width = sprite["size"]["width"];
-                int height = sprite["size"]["height"];
+            for (const auto& sprite : sheet.sprites) {
+                const std::string& fileName = sprite.name;
+                const std::string& extension = sprite.extension;
+                int x = sprite.x;
+                int y = sprite.y;
+                int width = sprite.width;
+                int height = sprite.height;
+
+                // trimmed sprites go back into their original canvas
+                int canvasWidth = width, canvasHeight = height, offsetX = 0, offsetY = 0;
+                if (sprite.trimmed) {
+                    canvasWidth = sprite.sourceWidth;
+                    canvasHeight = sprite.sourceHeight;
+                    offsetX = sprite.offsetX;
+                    offsetY = sprite.offsetY;
+                }
 
                 // Extract the sprite data from the texture
-                std::vector<unsigned char> spriteData(width * height * STBI_rgb_alpha);
-                for (int row = 0; row < height; ++row) {
-                    for (int col = 0; col < width; ++col) {
-                        int spriteIndex = (row * width + col) * STBI_rgb_alpha;
-                        int texIndex = ((y + row) * texWidth + (x + col)) * STBI_rgb_alpha;
-
-                        for (int c = 0; c < STBI_rgb_alpha; ++c) {
-                            spriteData[spriteIndex + c] = textureData[texIndex + c];
-                        }
-                    }
-                }
+                std::vector<unsigned char> spriteData(canvasWidth * canvasHeight * STBI_rgb_alpha, 0);
+                Blit::CopyRect(spriteData.data(), canvasWidth, offsetX, offsetY, textureData, texWidth, x, y, width, height);
+                width = canvasWidth;
+                height = canvasHeight;
 
                 outputPath = settings.OutputDirectory / fs::path(group) / (fileName + extension);
                 // Export the sprite
@@ -421,7 +1660,7 @@ namespace QLE {
                 for (int i = 0; i < jsons.size(); i++)
                     extractSpritesFromJson(jsons[i]);
             }
-            catch (std::exception e) {
+            catch (const std::exception& e) {
                 cerr << "[Error] " << e.what() << endl;
             }
             cout << "[Info] Texture Unpacking Completed" << endl;
@@ -431,13 +1670,57 @@ namespace QLE {
 #pragma region Input
         bool TexturePacker::Run(vector<string> args)
         {
+            // -client hands the other options to a running server, -server becomes one
+            // -project packs every group of the file, using the other options as defaults
+            for (size_t i = 0; i < args.size(); i++) {
+                if (args[i].starts_with("-client=")) {
+                    fs::path socketPath = args[i].substr(8);
+                    args.erase(args.begin() + i);
+                    return PackerServer::Submit(socketPath, args);
+                }
+                if (args[i].starts_with("-project=")) {
+                    fs::path projectFile = args[i].substr(9);
+                    args.erase(args.begin() + i);
+                    return PackProject(projectFile, args);
+                }
+                if (args[i].starts_with("-server=")) {
+                    int threadCount = 0, imageCacheMB = DEFAULT_IMAGE_CACHE_MB;
+                    for (const string& arg : args) {
+                        if (arg.starts_with("-threads=")) {
+                            try { threadCount = std::max(0, std::stoi(arg.substr(9))); }
+                            catch (std::invalid_argument e) { cerr << "[Error] Invalid input for threads. Defaulting to 0" << endl; }
+                        }
+                        else if (arg.starts_with("-image-cache=")) {
+                            try { imageCacheMB = std::max(0, std::stoi(arg.substr(13))); }
+                            catch (std::invalid_argument e) { cerr << "[Error] Invalid input for image-cache. Defaulting to " << DEFAULT_IMAGE_CACHE_MB << endl; }
+                        }
+                    }
+                    return PackerServer(args[i].substr(8), threadCount, (size_t)imageCacheMB * 1024 * 1024).Serve();
+                }
+            }
             PackingSettings settings;
+            PackingMode mode = parseArguments(args, settings);
+
+            // process action
+            if (mode == PackingMode::Help) return true;
+            if (mode == PackingMode::Error) return false;
+            if (mode == PackingMode::None)
+            {
+                cerr << "[Error] You forgot to pass \"-p\" or \"-u\" to tell the tool to pack or unpack" << endl;
+                return false;
+            }
+
+            if (mode == PackingMode::Pack) return settings.watch ? Watch(settings) : Pack(settings);
+            if (mode == PackingMode::Unpack) return Unpack(settings);
+
+            cerr << "[Error] Unprocessed action. See code TexturePacker::Run(vector<string>)" << endl;
+            return false;
+        }
+        PackingMode TexturePacker::parseArguments(const vector<string>& args, PackingSettings& settings)
+        {
             PackingMode mode = PackingMode::None;
             for (const string& arg : args) {
-                if (arg.starts_with("-help")) {
-                    mode = PackingMode::Error;
-                    return true;
-                }
+                if (arg.starts_with("-help")) return PackingMode::Help;
                 else if (arg == "-p") mode = PackingMode::Pack;
                 else if (arg == "-u") mode = PackingMode::Unpack;
                 else if (arg.starts_with("-i=")) {
@@ -462,6 +1745,24 @@ namespace QLE {
                 }
                 else if (arg == "-nonrecursive") settings.recursive = false;
                 else if (arg == "-compress") settings.useCompression = true;
+                else if (arg == "-compress=pngquant") settings.useCompressionTool = true;
+                else if (arg == "-dither") settings.dither = true;
+                else if (arg.starts_with("-colors=")) {
+                    try {
+                        settings.paletteColors = std::stoi(arg.substr(8));
+                        if (settings.paletteColors < 2 || settings.paletteColors > Quantizer::MaxColors) {
+                            cerr << "[Error] Invalid amount of colors. Defaulting to " << Quantizer::MaxColors << endl;
+                            settings.paletteColors = Quantizer::MaxColors;
+                        }
+                    }
+                    catch (std::invalid_argument e) {
+                        cerr << "[Error] Invalid input for colors. Defaulting to " << Quantizer::MaxColors << endl;
+                        settings.paletteColors = Quantizer::MaxColors;
+                    }
+                }
+                else if (arg == "-multibin") settings.multiBin = true;
+                else if (arg == "-trim") settings.trim = true;
+                else if (arg == "-dedup") settings.removeDuplicates = true;
                 else if (arg.starts_with("-size=")) {
                     try {
                         settings.MaxTextureSize = std::stoi(arg.substr(6));
@@ -475,6 +1776,107 @@ namespace QLE {
                         settings.MaxTextureSize = DEFAULT_SHEET_SIZE;
                     }
                 }
+                else if (arg.starts_with("-threads=")) {
+                    try {
+                        settings.threadCount = std::max(0, std::stoi(arg.substr(9)));
+                    }
+                    catch (std::invalid_argument e) {
+                        cerr << "[Error] Invalid input for threads. Defaulting to 0 (all hardware threads)" << endl;
+                        settings.threadCount = 0;
+                    }
+                }
+                else if (arg.starts_with("-png-threads=")) {
+                    try {
+                        settings.pngThreads = std::max(1, std::stoi(arg.substr(13)));
+                    }
+                    catch (std::invalid_argument e) {
+                        cerr << "[Error] Invalid input for png-threads. Defaulting to 1" << endl;
+                        settings.pngThreads = 1;
+                    }
+                }
+                else if (arg == "-incremental") settings.incremental = true;
+                else if (arg == "-cache-link") settings.cacheHardLinks = true;
+                else if (arg.starts_with("-cache-dir=")) settings.CacheDirectory = arg.substr(11);
+                else if (arg.starts_with("-cache-size=")) {
+                    try {
+                        settings.cacheSizeMB = std::max(0, std::stoi(arg.substr(12)));
+                    }
+                    catch (std::invalid_argument e) {
+                        cerr << "[Error] Invalid input for cache-size. Defaulting to " << DEFAULT_CACHE_SIZE_MB << endl;
+                        settings.cacheSizeMB = DEFAULT_CACHE_SIZE_MB;
+                    }
+                }
+                else if (arg == "-stats") settings.stats = true;
+                else if (arg.starts_with("-stats=")) {
+                    settings.stats = true;
+                    settings.StatsFile = arg.substr(7);
+                }
+                else if (arg.starts_with("-trace=")) settings.TraceFile = arg.substr(7);
+                else if (arg == "-watch") settings.watch = true;
+                else if (arg.starts_with("-watch-debounce=")) {
+                    try {
+                        settings.watchDebounceMs = std::max(0, std::stoi(arg.substr(16)));
+                    }
+                    catch (std::invalid_argument e) {
+                        cerr << "[Error] Invalid input for watch-debounce. Defaulting to " << DEFAULT_WATCH_DEBOUNCE_MS << endl;
+                        settings.watchDebounceMs = DEFAULT_WATCH_DEBOUNCE_MS;
+                    }
+                }
+                else if (arg.starts_with("-sheets-in-flight=")) {
+                    try {
+                        settings.sheetsInFlight = std::max(1, std::stoi(arg.substr(18)));
+                    }
+                    catch (std::invalid_argument e) {
+                        cerr << "[Error] Invalid input for sheets-in-flight. Defaulting to 3" << endl;
+                        settings.sheetsInFlight = 3;
+                    }
+                }
+                else if (arg.starts_with("-png-level=")) {
+                    try {
+                        settings.pngLevel = std::stoi(arg.substr(11));
+                        if (settings.pngLevel < 0 || settings.pngLevel > 9) {
+                            cerr << "[Error] Invalid png level. Defaulting to " << PngWriter::DefaultLevel << endl;
+                            settings.pngLevel = PngWriter::DefaultLevel;
+                        }
+                    }
+                    catch (std::invalid_argument e) {
+                        cerr << "[Error] Invalid input for png-level. Defaulting to " << PngWriter::DefaultLevel << endl;
+                        settings.pngLevel = PngWriter::DefaultLevel;
+                    }
+                }
+                else if (arg.starts_with("-png-filter=")) {
+                    if (!PngWriter::ParseFilter(arg.substr(12), settings.pngFilter)) {
+                        cerr << "[Error] Invalid png filter (" << arg.substr(12) << "). Defaulting to adaptive" << endl;
+                        settings.pngFilter = PngWriter::Filter::Adaptive;
+                    }
+                }
+                else if (arg == "-png-fast") {
+                    // a fixed filter skips trying all five on every row
+                    settings.pngLevel = 1;
+                    settings.pngFilter = PngWriter::Filter::Up;
+                }
+                else if (arg.starts_with("-heuristic=")) {
+                    if (!parseSortHeuristic(arg.substr(11), settings.heuristic)) {
+                        cerr << "[Error] Invalid heuristic (" << arg.substr(11) << "). Defaulting to none" << endl;
+                        settings.heuristic = SortHeuristic::None;
+                    }
+                }
+                else if (arg.starts_with("-meta=")) {
+                    const string format = arg.substr(6);
+                    if (format == "json") settings.meta = MetadataFormat::Json;
+                    else if (format == "bin") settings.meta = MetadataFormat::Binary;
+                    else if (format == "both") settings.meta = MetadataFormat::Both;
+                    else {
+                        cerr << "[Error] Invalid metadata format (" << format << "). Defaulting to json" << endl;
+                        settings.meta = MetadataFormat::Json;
+                    }
+                }
+                else if (arg.starts_with("-packer=")) {
+                    if (!RectPacker::Parse(arg.substr(8), settings.packer)) {
+                        cerr << "[Error] Invalid packer (" << arg.substr(8) << "). Defaulting to skyline" << endl;
+                        settings.packer = PackerType::Skyline;
+                    }
+                }
                 else if (arg.starts_with("-group=")) {
                     settings.Group = arg.substr(7);
                 }
@@ -508,19 +1910,7 @@ namespace QLE {
                 }
             }
 
-            // process action
-            if (mode == PackingMode::Error) return false;
-            if (mode == PackingMode::None)
-            {
-                cerr << "[Error] You forgot to pass \"-p\" or \"-u\" to tell the tool to pack or unpack" << endl;
-                return false;
-            }
-
-            if (mode == PackingMode::Pack) return Pack(settings);
-            if (mode == PackingMode::Unpack) return Unpack(settings);
-
-            cerr << "[Error] Unprocessed action. See code TexturePacker::Run(vector<string>)" << endl;
-            return false;
+            return mode;
         }
         bool TexturePacker::Run(string commands)
         {
@@ -554,7 +1944,7 @@ namespace QLE {
 #pragma endregion
 #pragma region Set pivot
 
-        void TexturePacker::overridePivot()
+        vector<fs::path> TexturePacker::pivotRulesFiles() const
         {
             vector<fs::path> jsonRulesPaths;
             string targetGroupRule = settings.Group + ".json";
@@ -565,23 +1955,53 @@ namespace QLE {
                 
                 jsonRulesPaths.push_back(entry.path());
             }
+            // later rules win, so the order can't depend on the directory listing
+            std::sort(jsonRulesPaths.begin(), jsonRulesPaths.end());
+            return jsonRulesPaths;
+        }
+        void TexturePacker::overridePivot()
+        {
+            vector<fs::path> jsonRulesPaths = pivotRulesFiles();
             if (jsonRulesPaths.empty()) {
                 cerr << "[Error] Unable to find any .json for pivot setting"<< endl;
                 return;
             }
-            for (auto path : jsonRulesPaths)
-                setPivot(path);
+            const PivotRules pivots = readPivotRules(jsonRulesPaths);
+            if (settings.WritesJson()) setPivot(pivots);
+            if (settings.WritesBinary()) setBinaryPivots(pivots);
+            cout << "[Info] Finished updating pivots for " << jsonRulesPaths.size() << " rule file(s)" << endl;
         }
-
-        void TexturePacker::setPivot(fs::path jsonRulesPath)
+        TexturePacker::PivotRules TexturePacker::readPivotRules(const vector<fs::path>& jsonRulesPaths) const
         {
-            // Load the JSON file
-            std::ifstream inputFile(jsonRulesPath);
-            if (!inputFile.is_open()) throw std::runtime_error("Failed to open rules file: " + jsonRulesPath.string());
-            nlohmann::json jsonRules;
-            inputFile >> jsonRules;
-            inputFile.close();
+            // a later rule of the same name wins
+            PivotRules pivots;
+            for (const auto& jsonRulesPath : jsonRulesPaths) {
+                std::ifstream inputFile(jsonRulesPath);
+                if (!inputFile.is_open()) throw std::runtime_error("Failed to open rules file: " + jsonRulesPath.string());
+                nlohmann::json jsonRules;
+                inputFile >> jsonRules;
+                for (const auto& rule : jsonRules["rules"])
+                    pivots[rule["name"].get<string>()] = { rule["pivot"]["x"].get<double>(), rule["pivot"]["y"].get<double>() };
+            }
+            return pivots;
+        }
+        void TexturePacker::setBinaryPivots(const PivotRules& rules)
+        {
+            std::unordered_map<string, std::pair<float, float>> pivots;
+            for (const auto& [name, pivot] : rules) pivots[name] = { (float)pivot.first, (float)pivot.second };
+            const fs::path binPath = settings.OutputDirectory / (settings.Group + ".bin");
+            std::ifstream input(binPath, std::ios::binary);
+            if (!input.is_open()) throw std::runtime_error("Failed to open sprite metadata: " + binPath.string());
+            std::vector<uint8_t> file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+            input.close();
+            if (BinaryMetadata::SetPivots(file, pivots) == 0) return;
+            // a hard link into the build cache is never written through
+            if (!SaveFileAtomically(binPath, file)) throw std::runtime_error("Failed to save sprite metadata: " + binPath.string());
+            cout << "[Info] Finished updating pivots in " << binPath << endl;
+        }
 
+        void TexturePacker::setPivot(const PivotRules& pivots)
+        {
             vector<fs::path> spritesheetJsons;
             if (settings.recursive) {
                 for (const auto& entry : fs::recursive_directory_iterator(settings.OutputDirectory))
@@ -594,32 +2014,27 @@ namespace QLE {
             // Process each sprite from the JSON data
             for (auto spritesheetJson : spritesheetJsons)
             {
-                bool hasChanges = false;
-                inputFile = std::ifstream(spritesheetJson);
-                if (!inputFile.is_open()) {
-                    throw std::runtime_error("Failed to open spritesheet file: " + spritesheetJson.string());
-                }
-                nlohmann::json spritesheetData;
-                inputFile >> spritesheetData;
-                inputFile.close();
-
-                if (spritesheetData["group"] != settings.Group) continue;
-                for (const auto rule : jsonRules["rules"]) {
-                    int spriteIndex = -1;
-                    for (const auto& sprite : spritesheetData["sprites"]) {
-                        spriteIndex++;
-                        if (sprite["name"] != rule["name"]) continue;
-                        spritesheetData["sprites"][spriteIndex]["pivot"]["x"] = rule["pivot"]["x"];
-                        spritesheetData["sprites"][spriteIndex]["pivot"]["y"] = rule["pivot"]["y"];
-                        hasChanges = true;
-                    }
-                }
-                if (!hasChanges) continue;
+                // the SAX pass tells which sprites change, so sheets of other groups or without a matching sprite are never built into a DOM
+                const string text = SheetJson::ReadText(spritesheetJson);
+                const SheetJson sheet = SheetJson::Parse(text);
+                if (sheet.group != settings.Group) continue;
+                vector<std::pair<size_t, std::pair<double, double>>> changes;
+                for (size_t spriteIndex = 0; spriteIndex < sheet.sprites.size(); spriteIndex++) {
+                    auto found = pivots.find(sheet.sprites[spriteIndex].name);
+                    if (found != pivots.end()) changes.push_back({ spriteIndex, found->second });
+                }
+                if (changes.empty()) continue;
+
+                // the rewrite keeps every other field as it is
+                nlohmann::json spritesheetData = nlohmann::json::parse(text);
+                for (const auto& [spriteIndex, pivot] : changes) {
+                    spritesheetData["sprites"][spriteIndex]["pivot"]["x"] = pivot.first;
+                    spritesheetData["sprites"][spriteIndex]["pivot"]["y"] = pivot.second;
+                }
                 std::ofstream updatedSpritesheet(spritesheetJson);
                 updatedSpritesheet << spritesheetData.dump(4);  // Pretty print with indentation
                 updatedSpritesheet.close();
             }
-            cout << "[Info] Finished updating pivots for " << jsonRulesPath << endl;
         }
 
 #pragma endregion
@@ -2,20 +2,76 @@
 #include <string>
 #include <filesystem>
 #include <vector>
+#include "RectPacker.h"
+#include "ThreadPool.h"
+#include "PngWriter.h"
+#include "Quantizer.h"
+#include "Manifest.h"
+#include "BuildCache.h"
+#include "ImageCache.h"
+#include "BuildStats.h"
+#include "Trace.h"
+#include "Atlas.h"
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace fs = std::filesystem;
 namespace QLE {
     namespace TextureTools {
 
 #define DEFAULT_SHEET_SIZE 2048
+#define DEFAULT_CACHE_SIZE_MB 1024
+#define DEFAULT_IMAGE_CACHE_MB 2048
+#define DEFAULT_WATCH_DEBOUNCE_MS 200
         using std::string;
         using std::vector;
 
         // Struct to store image data and metadata
         struct ImageData {
             std::string path;
-            int width, height, channels;
-            uint8_t* data;
+            int width = 0, height = 0, channels = 0;
+            uint8_t* data = nullptr;
+            // size of the image before trimming and where the trimmed area starts within it
+            int sourceWidth = 0, sourceHeight = 0;
+            int offsetX = 0, offsetY = 0;
+            // hash of the pixels, only set when looking for duplicates
+            uint64_t hash = 0;
+            // position in the list of images being packed, only set by PackAtlas
+            int index = 0;
+
+            inline bool IsTrimmed() const { return width != sourceWidth || height != sourceHeight; }
+        };
+        // A sheet on its way through the compose -> encode -> write stages
+        struct SheetJob {
+            int index = 0;
+            int width = 0, height = 0;
+            // RGBA pixels, released once the sheet is encoded
+            std::vector<unsigned char> pixels;
+            // the encoded .png file
+            std::vector<uint8_t> png;
+            // palette size when the sheet was quantized
+            int colors = 0;
+        };
+        // Order in which the images are handed to the packer
+        enum class SortHeuristic {
+            // keep the directory order and close a sheet at the first image that doesn't fit
+            None,
+            Height,
+            Area,
+            MaxSide,
+            Perimeter,
+            // tries every heuristic above and keeps the densest result
+            Best
+        };
+        // Files describing where the sprites are
+        enum class MetadataFormat {
+            // a .json per sheet
+            Json,
+            // a .bin per group, see BinaryMetadata.h
+            Binary,
+            Both
         };
         struct PackingSettings {
             // always power of two
@@ -29,11 +85,66 @@ namespace QLE {
             // spritesheet default name
             std::string Group = "general";
             bool recursive = true;
-            // if true, this will use pngquant compression
+            // if true, the sheets are reduced to an 8 bit palette before they're saved
             bool useCompression = false;
+            // palette size of the compressed sheets, 2 to 256
+            int paletteColors = Quantizer::MaxColors;
+            // Floyd-Steinberg dithering of the compressed sheets
+            bool dither = false;
+            // if true, this will run pngquant on every saved sheet
+            bool useCompressionTool = false;
             // by default, all pivots are set to 0.5,0.5
             // if set to true, we're going to override the pivot as long as you write a rule for it
             bool overridePivot = false;
+            // amount of threads used to decode images. 0 uses every hardware thread
+            int threadCount = 0;
+            // sorts all the images before packing them, trying to fill every sheet before opening a new one
+            SortHeuristic heuristic = SortHeuristic::None;
+            // algorithm used to place the images within a sheet
+            PackerType packer = PackerType::Skyline;
+            // keeps every sheet open while placing the images and rebalances them afterwards
+            // instead of filling the sheets one after the other
+            bool multiBin = false;
+            // removes the fully transparent borders of every image before packing it
+            bool trim = false;
+            // packs identical images only once. every copy is still listed in the .json
+            bool removeDuplicates = false;
+            // folder of the build cache. empty disables it
+            std::filesystem::path CacheDirectory;
+            // the least recently used builds are removed once the cache is bigger than this
+            int cacheSizeMB = DEFAULT_CACHE_SIZE_MB;
+            // hard links the .png files out of the cache instead of copying them
+            bool cacheHardLinks = false;
+            // keeps a manifest of the inputs next to the sheets and only rebuilds the sheets whose images changed
+            bool incremental = false;
+            // prints the time spent in every stage of the build
+            bool stats = false;
+            // also saves those numbers to this .json when set
+            std::filesystem::path StatsFile;
+            // saves the spans of every thread to this .json in the Chrome trace event format when set
+            std::filesystem::path TraceFile;
+            // keeps running after the first build and rebuilds whenever the input folder changes
+            bool watch = false;
+            // how long the input folder has to stay unchanged before rebuilding
+            int watchDebounceMs = DEFAULT_WATCH_DEBOUNCE_MS;
+            // sheets being composed, encoded or written at the same time. each one holds a full RGBA buffer
+            int sheetsInFlight = 3;
+            // amount of threads compressing every sheet
+            int pngThreads = 1;
+            // deflate effort of the sheets, 0 (stored) to 9 (smallest)
+            int pngLevel = PngWriter::DefaultLevel;
+            // row filter of the sheets. adaptive tries every filter on every row
+            PngWriter::Filter pngFilter = PngWriter::Filter::Adaptive;
+            // which files describe the sprites
+            MetadataFormat meta = MetadataFormat::Json;
+
+            // stb_image_write only covers the default single threaded RGBA settings
+            inline bool UsesPngWriter() const {
+                return useCompression || pngThreads > 1 || pngLevel != PngWriter::DefaultLevel || pngFilter != PngWriter::Filter::Adaptive;
+            }
+
+            inline bool WritesJson() const { return meta != MetadataFormat::Binary; }
+            inline bool WritesBinary() const { return meta != MetadataFormat::Json; }
 
             inline bool IsSizeWithinRange() const {
                 return
@@ -55,21 +166,91 @@ namespace QLE {
             None,
             Pack,
             Unpack,
-            Error
+            Error,
+            // -help was passed, nothing to do
+            Help
         };
         class TexturePacker
         {
         private:
             PackingSettings settings;
             string compressionTool;
+            // decoded images kept between builds. only set while watching or serving
+            std::shared_ptr<ImageCache> imageCache;
+            // every image listed by the builds since Watch last pruned the cache
+            std::unordered_set<string> listedImages;
+            // pool shared with other packers. each build makes its own when null
+            std::shared_ptr<ThreadPool> sharedPool;
+            // timings of the current build. only set with -stats
+            std::shared_ptr<BuildStats> stats;
+            // spans of the current build. only set with -trace
+            std::shared_ptr<Trace> trace;
 
             /* Packing */
             // Load image and metadata
             ImageData loadImage(const fs::path& imagePath);
+            // Read the image size without decoding the pixels. data is left empty
+            ImageData probeImage(const fs::path& imagePath);
+            // Load the image and crop its fully transparent borders
+            ImageData loadTrimmedImage(const fs::path& imagePath);
+            // Decode or copy an image given in memory into a buffer of its own
+            ImageData loadImage(const AtlasImage& source);
             // Function to compute the smallest power-of-two size that fits the dimensions
             int nextPowerOfTwo(int x);
-            // Pack images into texture sheets and handle multiple sheets if needed
-            void packImagesIntoSheets(const std::vector<fs::path>& imagePaths, const fs::path& outputDir, const std::string& Group);
+            // Moves the images with the same pixels as an earlier image out of images and into the aliases of that image
+            void removeDuplicateImages(vector<ImageData>& images, vector<vector<ImageData>>& aliases);
+            // Decide which sheet and where each image goes using only their sizes
+            vector<SheetLayout> planSheets(const vector<ImageData>& images);
+            // Packs the images in the given order, closing a sheet at the first image that doesn't fit
+            vector<SheetLayout> planSheetsInOrder(const vector<ImageData>& images);
+            // Sorts the images and keeps trying the remaining ones until a sheet is full
+            vector<SheetLayout> planSheetsSorted(const vector<ImageData>& images, SortHeuristic heuristic);
+            // First fit decreasing across all sheets, followed by a rebalancing and shrinking pass
+            vector<SheetLayout> planSheetsGlobal(const vector<ImageData>& images, SortHeuristic heuristic);
+            // Shrinks the sheet to the smallest power of two that holds its rects
+            void fitSheetSize(SheetLayout& layout);
+            // Decode the images of a planned sheet and copy them into it
+            void composeSheet(ThreadPool& pool, int index, const SheetLayout& layout, vector<ImageData>& images, vector<unsigned char>& sheet);
+            // Settings that change the sheets
+            string packingFingerprint() const;
+            // Settings that change the output, written to the manifest
+            string settingsFingerprint(const fs::path& outputDir) const;
+            // Key of the build cache entry for these images with the current settings
+            string buildCacheKey(const vector<fs::path>& imagePaths) const;
+            // Copies the sheets out of the cache. returns false on a miss
+            bool restoreFromCache(BuildCache& cache, const string& key);
+            /*
+            * Rebuilds the images and layouts of the last build from its manifest and marks the sheets whose images changed
+            * returns false if the layout can't be kept: images were added, removed or changed size
+            */
+            bool reusePreviousBuild(ThreadPool& pool, const Manifest& previous, const vector<fs::path>& imagePaths, const vector<FileStamp>& stamps,
+                vector<ImageData>& images, vector<vector<ImageData>>& aliases, vector<SheetLayout>& layouts, vector<bool>& dirty,
+                const fs::path& outputDir, const std::string& Group);
+            // Records where every image went
+            Manifest buildManifest(const vector<fs::path>& imagePaths, const vector<FileStamp>& stamps, const vector<ImageData>& images,
+                const vector<vector<ImageData>>& aliases, const vector<SheetLayout>& layouts, const fs::path& outputDir);
+            // Compress the composed pixels into a .png in memory
+            void encodeSheet(ThreadPool& pool, SheetJob& job);
+            // Save the encoded sheet and its .json
+            void writeSheet(const SheetJob& job, const SheetLayout& layout, const vector<ImageData>& images,
+                const vector<vector<ImageData>>& aliases, const fs::path& outputDir, const std::string& Group);
+            // Save the .bin describing every sheet of the group
+            void writeBinaryMetadata(const vector<SheetLayout>& layouts, const vector<ImageData>& images,
+                const vector<vector<ImageData>>& aliases, const fs::path& outputDir, const std::string& Group);
+            // The shared pool, or a new one for this build
+            std::shared_ptr<ThreadPool> acquirePool(int threadCount) const;
+            /*
+            * Pack images into texture sheets and handle multiple sheets if needed. returns the files of every sheet
+            * keptSheets tells if some of them are the files of the last incremental build, left as they were
+            */
+            vector<fs::path> packImagesIntoSheets(const std::vector<fs::path>& imagePaths, const fs::path& outputDir, const std::string& Group, bool& keptSheets);
+            // Starts a trace of the build when the settings ask for one
+            void startTrace();
+            void saveTrace();
+            // Packs the images with the current settings. shared by both Pack overloads
+            bool packListedImages(const vector<fs::path>& images);
+            // Reads the options into settings. returns the mode they ask for, Error if any of them is invalid
+            PackingMode parseArguments(const vector<string>& args, PackingSettings& settings);
             // Used when checking if a file is a valid image that we can use to pack within the spritesheet
             void checkIfCanAddImage(vector<fs::path>& images, const std::filesystem::directory_entry& entry);
             // Used to check if path 2 is found within path 1
@@ -86,12 +267,25 @@ namespace QLE {
             void showBanner();
 
             /* Pivot setting */
+            // the <group>.json rule files in the pivot directory
+            vector<fs::path> pivotRulesFiles() const;
+            // sprite name -> pivot, read once so the .json files and the .bin get the same pivots
+            using PivotRules = std::unordered_map<string, std::pair<double, double>>;
+            PivotRules readPivotRules(const vector<fs::path>& jsonRulesPaths) const;
             void overridePivot();
-            void setPivot(fs::path rule);
+            void setPivot(const PivotRules& pivots);
+            // applies every rule to the .bin of the group
+            void setBinaryPivots(const PivotRules& pivots);
         public:
             TexturePacker();
+            // without the banner, for packers used as a library
+            explicit TexturePacker(bool banner);
             bool IsCompressionToolInPath() const;
             bool IsExtensionSupported(string extension) const;
+            // keeps the decoded images in the cache and reuses them while their files are unchanged
+            void SetImageCache(std::shared_ptr<ImageCache> cache) { imageCache = std::move(cache); }
+            // runs the work of every build on this pool instead of one made per build
+            void SetThreadPool(std::shared_ptr<ThreadPool> pool) { sharedPool = std::move(pool); }
             // shows help menu
             void ShowHelp();
             /*
@@ -112,6 +306,27 @@ namespace QLE {
             * returns false if bad
             */
             bool Pack(PackingSettings settings);
+            // same as above with the images already listed, in the order the input folder would list them
+            bool Pack(PackingSettings settings, const vector<fs::path>& images);
+            /*
+            * packs images held in memory and returns the sheets with where every image went. nothing is read from or written to disk
+            * uses the packing options of settings: size, packer, heuristic, multibin, trim, dedup and threads
+            * with encode the sheets are also compressed to .png with the png and compress options
+            * throws std::runtime_error if an image can't be decoded or is bigger than a sheet
+            */
+            Atlas PackAtlas(std::span<const AtlasImage> images, PackingSettings settings = PackingSettings(), bool encode = false);
+            /*
+            * packs every group of a project file in one process, see the README for its format
+            * options are passed to every group before the options of the group itself
+            * the input folders are scanned once and the groups share one thread pool
+            * returns true if every group was packed
+            */
+            bool PackProject(const fs::path& projectFile, const vector<string>& options);
+            /*
+            * packs, then waits for the input folder to change and packs again until the process is stopped
+            * only the sheets whose images changed are rebuilt and the decoded images stay in memory
+            */
+            bool Watch(PackingSettings settings);
             /*
             * extracts individual textures from atlases and creates their original folder directory in the chosen path
             * returns true if everything is good
@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace QLE {
+    namespace TextureTools {
+        // the pool and worker index of the current thread, so nested submits land in the worker's own queue
+        static thread_local const ThreadPool* currentPool = nullptr;
+        static thread_local size_t currentWorker = 0;
+
+        ThreadPool::ThreadPool(int threadCount)
+        {
+            // the thread calling ParallelFor counts as one of the workers
+            int extraThreads = ResolveThreadCount(threadCount) - 1;
+            for (int i = 0; i < extraThreads; i++) queues.push_back(std::make_unique<Queue>());
+            for (int i = 0; i < extraThreads; i++)
+                workers.emplace_back(&ThreadPool::workerLoop, this, (size_t)i);
+        }
+        ThreadPool::~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wakeUp.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+        int ThreadPool::ResolveThreadCount(int threadCount)
+        {
+            if (threadCount > 0) return threadCount;
+            int hardwareThreads = (int)std::thread::hardware_concurrency();
+            return hardwareThreads > 0 ? hardwareThreads : 1;
+        }
+        bool ThreadPool::runNext(size_t index)
+        {
+            std::function<void()> task;
+            for (size_t i = 0; i < queues.size() && !task; i++) {
+                Queue& queue = *queues[(index + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.tasks.empty()) continue;
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                pending--;
+            }
+            if (!task) return false;
+            task();
+            return true;
+        }
+        void ThreadPool::workerLoop(size_t index)
+        {
+            currentPool = this;
+            currentWorker = index;
+            while (true) {
+                if (runNext(index)) continue;
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wakeUp.wait(lock, [this] { return stopping || pending > 0; });
+                // the queued tasks are still run when stopping
+                if (stopping && pending == 0) return;
+            }
+        }
+        void ThreadPool::Submit(std::function<void()> task)
+        {
+            if (queues.empty()) {
+                task();
+                return;
+            }
+            size_t index = currentPool == this ? currentWorker : nextQueue++ % queues.size();
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->mutex);
+                queues[index]->tasks.push_back(std::move(task));
+                pending++;
+            }
+            // taking the lock makes sure a worker checking pending is either before the check or already waiting
+            { std::lock_guard<std::mutex> lock(sleepMutex); }
+            wakeUp.notify_one();
+        }
+        void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& job)
+        {
+            if (count == 0) return;
+            if (workers.empty() || count == 1) {
+                for (size_t i = 0; i < count; i++) job(i);
+                return;
+            }
+
+            // shared with the helpers so late starters never touch a dead stack frame
+            struct Batch {
+                std::atomic<size_t> next = 0;
+                size_t finished = 0;
+                std::mutex mutex;
+                std::condition_variable done;
+                std::exception_ptr error;
+            };
+            auto batch = std::make_shared<Batch>();
+            auto work = [batch, count, &job]() {
+                size_t completed = 0;
+                for (size_t i = batch->next++; i < count; i = batch->next++) {
+                    try {
+                        job(i);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(batch->mutex);
+                        if (!batch->error) batch->error = std::current_exception();
+                    }
+                    completed++;
+                }
+                if (completed == 0) return;
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->finished += completed;
+                if (batch->finished == count) batch->done.notify_all();
+            };
+
+            size_t helpers = std::min(workers.size(), count - 1);
+            for (size_t i = 0; i < helpers; i++) Submit(work);
+            work();
+
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->done.wait(lock, [&] { return batch->finished == count; });
+            if (batch->error) std::rethrow_exception(batch->error);
+        }
+    }
+}
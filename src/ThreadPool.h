@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * Fixed size pool of worker threads used by the packing stages
+        * every worker has its own queue. tasks submitted from a worker go to its queue and are taken newest first,
+        * idle workers steal the oldest tasks of the others, so nested work stays local while nothing sits idle
+        */
+        class ThreadPool
+        {
+        private:
+            struct Queue {
+                std::mutex mutex;
+                std::deque<std::function<void()>> tasks;
+            };
+            std::vector<std::thread> workers;
+            std::vector<std::unique_ptr<Queue>> queues;
+            // queue of the next task submitted from outside the pool
+            std::atomic<size_t> nextQueue = 0;
+            // tasks queued and not taken yet
+            std::atomic<size_t> pending = 0;
+            std::mutex sleepMutex;
+            std::condition_variable wakeUp;
+            bool stopping = false;
+
+            void workerLoop(size_t index);
+            // runs a task of the own queue or one stolen from another. false if every queue was empty
+            bool runNext(size_t index);
+        public:
+            // 0 or less uses every hardware thread available
+            explicit ThreadPool(int threadCount);
+            ~ThreadPool();
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            // number of threads that can run work, including the calling thread
+            int Size() const { return (int)workers.size() + 1; }
+            // queues a task to be picked up by any worker. runs it right away if the pool has no workers
+            void Submit(std::function<void()> task);
+            /*
+            * runs job(i) for every i in [0, count) and returns once all of them are done
+            * the calling thread works on the items too, so it is safe to call from inside a task
+            * rethrows the first exception thrown by a job
+            */
+            void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+            // resolves 0 or less to the amount of hardware threads
+            static int ResolveThreadCount(int threadCount);
+        };
+    }
+}
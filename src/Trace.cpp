@@ -0,0 +1,91 @@
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include "../include/json.hpp" // For writing the events
+
+namespace QLE {
+    namespace TextureTools {
+        static std::atomic<uint64_t> nextGeneration = 1;
+        // the thread number in the last trace this thread added to
+        static thread_local uint64_t cachedGeneration = 0;
+        static thread_local int cachedThread = 0;
+
+        Trace::Trace() : origin(std::chrono::steady_clock::now()), generation(nextGeneration++)
+        {
+        }
+        int64_t Trace::now() const
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+        }
+        int Trace::threadId()
+        {
+            if (cachedGeneration == generation) return cachedThread;
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            auto found = threadIds.try_emplace(std::this_thread::get_id(), (int)threadIds.size() + 1).first;
+            cachedGeneration = generation;
+            cachedThread = found->second;
+            return cachedThread;
+        }
+        void Trace::NameThread(const std::string& name)
+        {
+            int thread = threadId();
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            threadNames[thread] = name;
+        }
+        void Trace::add(Event event)
+        {
+            Bucket& bucket = buckets[event.thread % BucketCount];
+            std::lock_guard<std::mutex> lock(bucket.mutex);
+            bucket.events.push_back(std::move(event));
+        }
+
+        Trace::Span::Span(Trace* trace, const char* name, const char* category, const std::string& detail)
+            : trace(trace), name(name), category(category)
+        {
+            if (!trace) return;
+            this->detail = detail;
+            start = trace->now();
+        }
+        Trace::Span::~Span()
+        {
+            if (!trace) return;
+            trace->add({ name, category, std::move(detail), trace->threadId(), start, trace->now() - start });
+        }
+
+        void Trace::Save(const std::filesystem::path& path) const
+        {
+            std::vector<Event> events;
+            for (const auto& bucket : buckets) {
+                std::lock_guard<std::mutex> lock(bucket.mutex);
+                events.insert(events.end(), bucket.events.begin(), bucket.events.end());
+            }
+            std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.start < b.start; });
+
+            nlohmann::json list = nlohmann::json::array();
+            {
+                std::lock_guard<std::mutex> lock(threadsMutex);
+                for (const auto& [id, thread] : threadIds) {
+                    auto named = threadNames.find(thread);
+                    std::string name = named != threadNames.end() ? named->second : "worker " + std::to_string(thread);
+                    list.push_back({ {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", thread}, {"args", {{"name", name}}} });
+                    // keeps the named threads on top
+                    list.push_back({ {"name", "thread_sort_index"}, {"ph", "M"}, {"pid", 1}, {"tid", thread}, {"args", {{"sort_index", thread}}} });
+                }
+            }
+            for (const auto& event : events) {
+                nlohmann::json entry = {
+                    {"name", event.name}, {"cat", event.category}, {"ph", "X"},
+                    {"ts", event.start}, {"dur", event.duration}, {"pid", 1}, {"tid", event.thread}
+                };
+                if (!event.detail.empty()) entry["args"] = { {"detail", event.detail} };
+                list.push_back(std::move(entry));
+            }
+
+            std::ofstream file(path);
+            if (!file.is_open()) throw std::runtime_error("Failed to write the trace to " + path.string());
+            file << nlohmann::json{ {"traceEvents", list}, {"displayTimeUnit", "ms"} }.dump();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace QLE {
+    namespace TextureTools {
+        /*
+        * Spans of work on every thread, saved in the Chrome trace event format
+        * open the file in chrome://tracing or ui.perfetto.dev
+        * safe to use from several threads. spans are kept in a few buckets so threads rarely wait on each other
+        */
+        class Trace
+        {
+        public:
+            // records the time from construction to destruction on the calling thread. does nothing without a trace
+            class Span
+            {
+            private:
+                Trace* trace;
+                const char* name;
+                const char* category;
+                std::string detail;
+                int64_t start = 0;
+            public:
+                // name and category have to outlive the trace, detail is copied
+                Span(Trace* trace, const char* name, const char* category, const std::string& detail = std::string());
+                ~Span();
+                Span(const Span&) = delete;
+                Span& operator=(const Span&) = delete;
+            };
+        private:
+            struct Event {
+                const char* name;
+                const char* category;
+                std::string detail;
+                int thread;
+                int64_t start, duration;
+            };
+            struct Bucket {
+                mutable std::mutex mutex;
+                std::vector<Event> events;
+            };
+            static const int BucketCount = 16;
+            Bucket buckets[BucketCount];
+            std::chrono::steady_clock::time_point origin;
+            // tells traces apart in the per thread cache of threadId
+            uint64_t generation;
+
+            mutable std::mutex threadsMutex;
+            std::unordered_map<std::thread::id, int> threadIds;
+            std::map<int, std::string> threadNames;
+
+            // microseconds since the trace started
+            int64_t now() const;
+            // small number of the calling thread, in order of appearance
+            int threadId();
+            void add(Event event);
+        public:
+            Trace();
+
+            // shown instead of the thread number
+            void NameThread(const std::string& name);
+            void Save(const std::filesystem::path& path) const;
+        };
+    }
+}